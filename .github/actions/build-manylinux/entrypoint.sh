@@ -39,5 +39,6 @@ cp build/seqc seq-deploy/bin/
 cp build/libseq*.so seq-deploy/lib/seq/
 cp build/libomp.so seq-deploy/lib/seq/
 cp -r stdlib seq-deploy/lib/seq/
+cp build/stdlib.snap seq-deploy/lib/seq/
 tar -czf ${SEQ_BUILD_ARCHIVE} seq-deploy
 du -sh seq-deploy
@@ -48,6 +48,7 @@ namespace seq {
 namespace ast {
 
 /// Forward declarations
+class Snapshot;
 struct SimplifyContext;
 class SimplifyVisitor;
 struct TypeContext;
@@ -99,6 +100,8 @@ struct Cache : public std::enable_shared_from_this<Cache> {
   string module0;
   /// LLVM module.
   seq::ir::Module *module = nullptr;
+  /// Pre-parsed standard library snapshot (nullptr if not available).
+  shared_ptr<Snapshot> snapshot;
 
   /// Table of imported files that maps an absolute filename to a Import structure.
   /// By convention, the key of Seq standard library is "".
@@ -6,7 +6,9 @@
  * file 'LICENSE', which is part of this source code package.
  */
 
+#include <algorithm>
 #include <chrono>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -15,6 +17,7 @@
 #include "parser/cache.h"
 #include "parser/parser.h"
 #include "parser/peg/peg.h"
+#include "parser/snapshot.h"
 #include "parser/visitors/doc/doc.h"
 #include "parser/visitors/format/format.h"
 #include "parser/visitors/simplify/simplify.h"
@@ -22,6 +25,7 @@
 #include "parser/visitors/typecheck/typecheck.h"
 #include "sir/sir.h"
 #include "util/fmt/format.h"
+#include "util/stats.h"
 
 #include "sir/util/format.h"
 #include <fstream>
@@ -54,8 +58,13 @@ ir::Module *parse(const string &argv0, const string &file, const string &code,
       realpath(file.c_str(), abs);
 
     auto cache = make_shared<ast::Cache>(argv0);
-    ast::StmtPtr codeStmt = isCode ? ast::parseCode(cache, abs, code, startLine)
-                                   : ast::parseFile(cache, abs);
+    cache->snapshot = ast::Snapshot::open(argv0);
+    ast::StmtPtr codeStmt;
+    {
+      CompileStats::Timer timer("parser", "parse");
+      codeStmt = isCode ? ast::parseCode(cache, abs, code, startLine)
+                        : ast::parseFile(cache, abs);
+    }
     if (_dbg_level) {
       auto fo = fopen("_dump.sexp", "w");
       fmt::print(fo, "{}\n", codeStmt->toString(0));
@@ -69,8 +78,12 @@ ir::Module *parse(const string &argv0, const string &file, const string &code,
 
     auto t = high_resolution_clock::now();
 
-    auto transformed =
-        ast::SimplifyVisitor::apply(cache, move(codeStmt), abs, defines, (isTest > 1));
+    ast::StmtPtr transformed;
+    {
+      CompileStats::Timer timer("parser", "simplify");
+      transformed =
+          ast::SimplifyVisitor::apply(cache, move(codeStmt), abs, defines, (isTest > 1));
+    }
     if (!isTest) {
       LOG_TIME("[T] ocaml = {:.1f}", _ocaml_time / 1000.0);
       LOG_TIME("[T] simplify = {:.1f}",
@@ -88,7 +101,11 @@ ir::Module *parse(const string &argv0, const string &file, const string &code,
     }
 
     t = high_resolution_clock::now();
-    auto typechecked = ast::TypecheckVisitor::apply(cache, move(transformed));
+    ast::StmtPtr typechecked;
+    {
+      CompileStats::Timer timer("parser", "typecheck");
+      typechecked = ast::TypecheckVisitor::apply(cache, move(transformed));
+    }
     if (!isTest) {
       LOG_TIME("[T] typecheck = {:.1f}",
                duration_cast<milliseconds>(high_resolution_clock::now() - t).count() /
@@ -107,7 +124,11 @@ ir::Module *parse(const string &argv0, const string &file, const string &code,
     }
 
     t = high_resolution_clock::now();
-    auto *module = ast::TranslateVisitor::apply(cache, move(typechecked));
+    ir::Module *module;
+    {
+      CompileStats::Timer timer("parser", "translate");
+      module = ast::TranslateVisitor::apply(cache, move(typechecked));
+    }
     module->setSrcInfo({abs, 0, 0, 0});
 
     if (!isTest)
@@ -156,4 +177,35 @@ void generateDocstr(const string &argv0) {
   }
 }
 
+bool generateSnapshot(const string &argv0, const string &dir, const string &output) {
+  vector<string> files;
+  for (auto &entry : std::filesystem::recursive_directory_iterator(dir))
+    if (entry.is_regular_file() && entry.path().extension() == ".seq")
+      files.push_back(std::filesystem::canonical(entry.path()).string());
+  std::sort(files.begin(), files.end());
+
+  try {
+    auto cache = make_shared<ast::Cache>(argv0);
+    vector<ast::Snapshot::Entry> entries;
+    for (auto &file : files) {
+      auto ast = ast::parseFile(cache, file);
+      // Reconstruct the exact code that parseFile() hands to the parser.
+      string code;
+      for (auto &line : cache->imports[file].content)
+        code += line + "\n";
+      entries.push_back({file, code, ast});
+    }
+    ast::Snapshot::write(output, entries);
+    LOG_USER("wrote {} files to {}", entries.size(), output);
+    return true;
+  } catch (exc::ParserException &e) {
+    for (int i = 0; i < e.messages.size(); i++)
+      if (!e.messages[i].empty()) {
+        compilationError(e.messages[i], e.locations[i].file, e.locations[i].line,
+                         e.locations[i].col, /*terminate=*/false);
+      }
+    return false;
+  }
+}
+
 } // namespace seq
@@ -25,4 +25,10 @@ seq::ir::Module *parse(const std::string &argv0, const std::string &file,
 
 void generateDocstr(const std::string &argv0);
 
+/// Parse all .seq files in dir and write their ASTs to a snapshot file output
+/// (see ast::Snapshot).
+/// @return true if the snapshot was written successfully
+bool generateSnapshot(const std::string &argv0, const std::string &dir,
+                      const std::string &output);
+
 } // namespace seq
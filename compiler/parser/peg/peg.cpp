@@ -15,9 +15,11 @@
 #include <vector>
 
 #include "parser/ast.h"
+#include "parser/cache.h"
 #include "parser/common.h"
 #include "parser/peg/peg.h"
 #include "parser/peg/rules.h"
+#include "parser/snapshot.h"
 #include "parser/visitors/format/format.h"
 #include "util/peglib.h"
 
@@ -118,6 +120,9 @@ StmtPtr parseFile(const shared_ptr<Cache> &cache, const string &file) {
   }
 
   cache->imports[file].content = lines;
+  if (cache->snapshot)
+    if (auto result = cache->snapshot->load(cache, file, code))
+      return result;
   auto result = parseCode(cache, file, code);
   // LOG("peg/{} :=  {}", file, result ? result->toString(0) : "<nullptr>");
   // throw;
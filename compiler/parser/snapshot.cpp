@@ -0,0 +1,1092 @@
+/*
+ * snapshot.cpp --- Binary snapshots of pre-parsed Seq source files.
+ *
+ * (c) Seq project. All rights reserved.
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <libgen.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "parser/cache.h"
+#include "parser/common.h"
+#include "parser/snapshot.h"
+#include "parser/visitors/visitor.h"
+
+using fmt::format;
+using std::move;
+
+/// Bump whenever the AST layout or the serialization format changes.
+#define SNAPSHOT_MAGIC "SEQSNAP"
+#define SNAPSHOT_VERSION 2
+
+namespace seq {
+namespace ast {
+
+namespace {
+
+enum Tag : uint8_t {
+  T_NULL = 0,
+  // Expressions
+  T_NONE,
+  T_BOOL,
+  T_INT,
+  T_FLOAT,
+  T_STRING,
+  T_ID,
+  T_STAR,
+  T_KWSTAR,
+  T_TUPLE,
+  T_LIST,
+  T_SET,
+  T_DICT,
+  T_GENERATOR,
+  T_DICT_GENERATOR,
+  T_IF,
+  T_UNARY,
+  T_BINARY,
+  T_CHAIN_BINARY,
+  T_PIPE,
+  T_INDEX,
+  T_CALL,
+  T_DOT,
+  T_SLICE,
+  T_ELLIPSIS,
+  T_LAMBDA,
+  T_YIELD,
+  T_ASSIGN_EXPR,
+  T_RANGE,
+  // Statements
+  T_SUITE,
+  T_BREAK,
+  T_CONTINUE,
+  T_EXPR_STMT,
+  T_ASSIGN,
+  T_DEL,
+  T_PRINT,
+  T_RETURN,
+  T_YIELD_STMT,
+  T_ASSERT,
+  T_WHILE,
+  T_FOR,
+  T_IF_STMT,
+  T_MATCH,
+  T_IMPORT,
+  T_TRY,
+  T_GLOBAL,
+  T_THROW,
+  T_FUNCTION,
+  T_CLASS,
+  T_YIELD_FROM,
+  T_WITH,
+  T_CUSTOM,
+};
+
+uint64_t contentHash(const string &code) {
+  // 64-bit FNV-1a: stable across builds and platforms, unlike std::hash.
+  uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c : code) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/// Serializes parsed AST nodes. Only nodes produced by the parser are supported;
+/// nodes created by later stages raise an error.
+struct SnapshotWriter : public ASTVisitor {
+  string &out;
+  const string &file;
+
+  SnapshotWriter(string &out, const string &file) : out(out), file(file) {}
+
+  void u8(uint8_t v) { out.push_back(char(v)); }
+  void uv(uint64_t v) {
+    do {
+      uint8_t b = v & 0x7f;
+      v >>= 7;
+      u8(v ? (b | 0x80) : b);
+    } while (v);
+  }
+  void sv(int64_t v) { uv((uint64_t(v) << 1) ^ uint64_t(v >> 63)); }
+  void str(const string &s) {
+    uv(s.size());
+    out.append(s);
+  }
+  void f64(double d) {
+    char buf[sizeof(double)];
+    memcpy(buf, &d, sizeof(double));
+    out.append(buf, sizeof(double));
+  }
+  void src(const SrcObject *node) {
+    auto info = node->getSrcInfo();
+    if (info.file == file) {
+      u8(0);
+    } else {
+      u8(1);
+      str(info.file);
+    }
+    sv(info.line);
+    sv(info.col);
+    sv(info.len);
+  }
+
+  void expr(Expr *e) {
+    if (!e)
+      return u8(T_NULL);
+    e->accept(*this);
+  }
+  void exprs(const vector<ExprPtr> &es) {
+    uv(es.size());
+    for (auto &e : es)
+      expr(e.get());
+  }
+  void stmt(Stmt *s) {
+    if (!s)
+      return u8(T_NULL);
+    s->accept(*this);
+  }
+  void strs(const vector<string> &ss) {
+    uv(ss.size());
+    for (auto &s : ss)
+      str(s);
+  }
+  void param(const Param &p) {
+    src(&p);
+    str(p.name);
+    expr(p.type.get());
+    expr(p.deflt.get());
+    u8(p.generic);
+  }
+  void params(const vector<Param> &ps) {
+    uv(ps.size());
+    for (auto &p : ps)
+      param(p);
+  }
+  void args(const vector<CallExpr::Arg> &as) {
+    uv(as.size());
+    for (auto &a : as) {
+      str(a.name);
+      expr(a.value.get());
+    }
+  }
+  void loops(const vector<GeneratorBody> &ls) {
+    uv(ls.size());
+    for (auto &l : ls) {
+      expr(l.vars.get());
+      expr(l.gen.get());
+      exprs(l.conds);
+    }
+  }
+  void attr(const Attr &a) {
+    str(a.module);
+    str(a.parentClass);
+    u8(a.isAttribute);
+    uv(a.customAttr.size());
+    for (auto &s : a.customAttr)
+      str(s);
+  }
+
+  /// Common expression header.
+  void head(Tag tag, Expr *e) {
+    if (e->type)
+      internalError(e, "cannot snapshot a type-checked expression");
+    u8(tag);
+    src(e);
+    u8(uint8_t(e->isTypeExpr) | (uint8_t(e->done) << 1));
+    u8(e->staticValue.type);
+    u8(e->staticValue.evaluated);
+    if (e->staticValue.evaluated) {
+      if (e->staticValue.type == StaticValue::INT)
+        sv(std::get<int64_t>(e->staticValue.value));
+      else if (e->staticValue.type == StaticValue::STRING)
+        str(std::get<string>(e->staticValue.value));
+    }
+  }
+  /// Common statement header.
+  void head(Tag tag, Stmt *s) {
+    u8(tag);
+    src(s);
+    u8(s->done);
+    sv(s->age);
+  }
+
+  template <typename T> void internalError(T *node, const string &msg) {
+    throw exc::ParserException(msg, node->getSrcInfo());
+  }
+  void defaultVisit(Expr *e) override {
+    internalError(e, format("cannot snapshot expression {}", e->toString()));
+  }
+  void defaultVisit(Stmt *s) override {
+    internalError(s, format("cannot snapshot statement {}", s->toString()));
+  }
+
+  void visit(NoneExpr *e) override { head(T_NONE, e); }
+  void visit(BoolExpr *e) override {
+    head(T_BOOL, e);
+    u8(e->value);
+  }
+  void visit(IntExpr *e) override {
+    head(T_INT, e);
+    str(e->value);
+    str(e->suffix);
+    sv(e->intValue);
+  }
+  void visit(FloatExpr *e) override {
+    head(T_FLOAT, e);
+    str(e->value);
+    str(e->suffix);
+    f64(e->floatValue);
+  }
+  void visit(StringExpr *e) override {
+    head(T_STRING, e);
+    uv(e->strings.size());
+    for (auto &s : e->strings) {
+      str(s.first);
+      str(s.second);
+    }
+  }
+  void visit(IdExpr *e) override {
+    head(T_ID, e);
+    str(e->value);
+  }
+  void visit(StarExpr *e) override {
+    head(T_STAR, e);
+    expr(e->what.get());
+  }
+  void visit(KeywordStarExpr *e) override {
+    head(T_KWSTAR, e);
+    expr(e->what.get());
+  }
+  void visit(TupleExpr *e) override {
+    head(T_TUPLE, e);
+    exprs(e->items);
+  }
+  void visit(ListExpr *e) override {
+    head(T_LIST, e);
+    exprs(e->items);
+  }
+  void visit(SetExpr *e) override {
+    head(T_SET, e);
+    exprs(e->items);
+  }
+  void visit(DictExpr *e) override {
+    head(T_DICT, e);
+    uv(e->items.size());
+    for (auto &i : e->items) {
+      expr(i.key.get());
+      expr(i.value.get());
+    }
+  }
+  void visit(GeneratorExpr *e) override {
+    head(T_GENERATOR, e);
+    u8(e->kind);
+    expr(e->expr.get());
+    loops(e->loops);
+  }
+  void visit(DictGeneratorExpr *e) override {
+    head(T_DICT_GENERATOR, e);
+    expr(e->key.get());
+    expr(e->expr.get());
+    loops(e->loops);
+  }
+  void visit(IfExpr *e) override {
+    head(T_IF, e);
+    expr(e->cond.get());
+    expr(e->ifexpr.get());
+    expr(e->elsexpr.get());
+  }
+  void visit(UnaryExpr *e) override {
+    head(T_UNARY, e);
+    str(e->op);
+    expr(e->expr.get());
+  }
+  void visit(BinaryExpr *e) override {
+    head(T_BINARY, e);
+    str(e->op);
+    expr(e->lexpr.get());
+    expr(e->rexpr.get());
+    u8(e->inPlace);
+  }
+  void visit(ChainBinaryExpr *e) override {
+    head(T_CHAIN_BINARY, e);
+    uv(e->exprs.size());
+    for (auto &i : e->exprs) {
+      str(i.first);
+      expr(i.second.get());
+    }
+  }
+  void visit(PipeExpr *e) override {
+    head(T_PIPE, e);
+    uv(e->items.size());
+    for (auto &i : e->items) {
+      str(i.op);
+      expr(i.expr.get());
+    }
+  }
+  void visit(IndexExpr *e) override {
+    head(T_INDEX, e);
+    expr(e->expr.get());
+    expr(e->index.get());
+  }
+  void visit(CallExpr *e) override {
+    head(T_CALL, e);
+    expr(e->expr.get());
+    args(e->args);
+    u8(e->ordered);
+  }
+  void visit(DotExpr *e) override {
+    head(T_DOT, e);
+    expr(e->expr.get());
+    str(e->member);
+  }
+  void visit(SliceExpr *e) override {
+    head(T_SLICE, e);
+    expr(e->start.get());
+    expr(e->stop.get());
+    expr(e->step.get());
+  }
+  void visit(EllipsisExpr *e) override {
+    head(T_ELLIPSIS, e);
+    u8(e->isPipeArg);
+  }
+  void visit(LambdaExpr *e) override {
+    head(T_LAMBDA, e);
+    strs(e->vars);
+    expr(e->expr.get());
+  }
+  void visit(YieldExpr *e) override { head(T_YIELD, e); }
+  void visit(AssignExpr *e) override {
+    head(T_ASSIGN_EXPR, e);
+    expr(e->var.get());
+    expr(e->expr.get());
+  }
+  void visit(RangeExpr *e) override {
+    head(T_RANGE, e);
+    expr(e->start.get());
+    expr(e->stop.get());
+  }
+
+  void visit(SuiteStmt *s) override {
+    head(T_SUITE, s);
+    uv(s->stmts.size());
+    for (auto &i : s->stmts)
+      stmt(i.get());
+    u8(s->ownBlock);
+  }
+  void visit(BreakStmt *s) override { head(T_BREAK, s); }
+  void visit(ContinueStmt *s) override { head(T_CONTINUE, s); }
+  void visit(ExprStmt *s) override {
+    head(T_EXPR_STMT, s);
+    expr(s->expr.get());
+  }
+  void visit(AssignStmt *s) override {
+    head(T_ASSIGN, s);
+    expr(s->lhs.get());
+    expr(s->rhs.get());
+    expr(s->type.get());
+    u8(s->shadow);
+  }
+  void visit(DelStmt *s) override {
+    head(T_DEL, s);
+    expr(s->expr.get());
+  }
+  void visit(PrintStmt *s) override {
+    head(T_PRINT, s);
+    exprs(s->items);
+    u8(s->isInline);
+  }
+  void visit(ReturnStmt *s) override {
+    head(T_RETURN, s);
+    expr(s->expr.get());
+  }
+  void visit(YieldStmt *s) override {
+    head(T_YIELD_STMT, s);
+    expr(s->expr.get());
+  }
+  void visit(AssertStmt *s) override {
+    head(T_ASSERT, s);
+    expr(s->expr.get());
+    expr(s->message.get());
+  }
+  void visit(WhileStmt *s) override {
+    head(T_WHILE, s);
+    expr(s->cond.get());
+    stmt(s->suite.get());
+    stmt(s->elseSuite.get());
+  }
+  void visit(ForStmt *s) override {
+    head(T_FOR, s);
+    expr(s->var.get());
+    expr(s->iter.get());
+    stmt(s->suite.get());
+    stmt(s->elseSuite.get());
+    expr(s->decorator.get());
+    args(s->ompArgs);
+    u8(s->wrapped);
+  }
+  void visit(IfStmt *s) override {
+    head(T_IF_STMT, s);
+    expr(s->cond.get());
+    stmt(s->ifSuite.get());
+    stmt(s->elseSuite.get());
+  }
+  void visit(MatchStmt *s) override {
+    head(T_MATCH, s);
+    expr(s->what.get());
+    uv(s->cases.size());
+    for (auto &c : s->cases) {
+      expr(c.pattern.get());
+      expr(c.guard.get());
+      stmt(c.suite.get());
+    }
+  }
+  void visit(ImportStmt *s) override {
+    head(T_IMPORT, s);
+    expr(s->from.get());
+    expr(s->what.get());
+    str(s->as);
+    sv(s->dots);
+    params(s->args);
+    expr(s->ret.get());
+  }
+  void visit(TryStmt *s) override {
+    head(T_TRY, s);
+    stmt(s->suite.get());
+    uv(s->catches.size());
+    for (auto &c : s->catches) {
+      str(c.var);
+      expr(c.exc.get());
+      stmt(c.suite.get());
+    }
+    stmt(s->finally.get());
+  }
+  void visit(GlobalStmt *s) override {
+    head(T_GLOBAL, s);
+    str(s->var);
+  }
+  void visit(ThrowStmt *s) override {
+    head(T_THROW, s);
+    expr(s->expr.get());
+    u8(s->transformed);
+  }
+  void visit(FunctionStmt *s) override {
+    head(T_FUNCTION, s);
+    str(s->name);
+    expr(s->ret.get());
+    params(s->args);
+    stmt(s->suite.get());
+    attr(s->attributes);
+    exprs(s->decorators);
+  }
+  void visit(ClassStmt *s) override {
+    head(T_CLASS, s);
+    str(s->name);
+    params(s->args);
+    stmt(s->suite.get());
+    attr(s->attributes);
+    exprs(s->decorators);
+    exprs(s->baseClasses);
+  }
+  void visit(YieldFromStmt *s) override {
+    head(T_YIELD_FROM, s);
+    expr(s->expr.get());
+  }
+  void visit(WithStmt *s) override {
+    head(T_WITH, s);
+    exprs(s->items);
+    strs(s->vars);
+    stmt(s->suite.get());
+  }
+  void visit(CustomStmt *s) override {
+    head(T_CUSTOM, s);
+    str(s->keyword);
+    expr(s->expr.get());
+    stmt(s->suite.get());
+  }
+};
+
+/// Error raised on malformed snapshot data.
+struct SnapshotError {};
+
+/// Deserializes AST nodes written by SnapshotWriter.
+struct SnapshotReader {
+  const char *p, *end;
+  const string &file;
+
+  SnapshotReader(const char *p, const char *end, const string &file)
+      : p(p), end(end), file(file) {}
+
+  uint8_t u8() {
+    if (p >= end)
+      throw SnapshotError();
+    return uint8_t(*p++);
+  }
+  uint64_t uv() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      auto b = u8();
+      v |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+    throw SnapshotError();
+  }
+  int64_t sv() {
+    auto v = uv();
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+  }
+  string str() {
+    auto n = uv();
+    if (n > uint64_t(end - p))
+      throw SnapshotError();
+    string s(p, n);
+    p += n;
+    return s;
+  }
+  double f64() {
+    if (end - p < ptrdiff_t(sizeof(double)))
+      throw SnapshotError();
+    double d;
+    memcpy(&d, p, sizeof(double));
+    p += sizeof(double);
+    return d;
+  }
+  SrcInfo src() {
+    auto f = u8() ? str() : file;
+    auto line = int(sv());
+    auto col = int(sv());
+    auto len = int(sv());
+    return SrcInfo(f, line, col, len);
+  }
+
+  vector<ExprPtr> exprs() {
+    vector<ExprPtr> es(uv());
+    for (auto &e : es)
+      e = expr();
+    return es;
+  }
+  vector<string> strs() {
+    vector<string> ss(uv());
+    for (auto &s : ss)
+      s = str();
+    return ss;
+  }
+  Param param() {
+    auto info = src();
+    Param p;
+    p.setSrcInfo(info);
+    p.name = str();
+    p.type = expr();
+    p.deflt = expr();
+    p.generic = u8();
+    return p;
+  }
+  vector<Param> params() {
+    vector<Param> ps;
+    for (auto n = uv(); n--;)
+      ps.push_back(param());
+    return ps;
+  }
+  vector<CallExpr::Arg> args() {
+    vector<CallExpr::Arg> as;
+    for (auto n = uv(); n--;) {
+      auto name = str();
+      as.push_back({name, expr()});
+    }
+    return as;
+  }
+  vector<GeneratorBody> loops() {
+    vector<GeneratorBody> ls;
+    for (auto n = uv(); n--;) {
+      GeneratorBody l;
+      l.vars = expr();
+      l.gen = expr();
+      l.conds = exprs();
+      ls.push_back(move(l));
+    }
+    return ls;
+  }
+  Attr attr() {
+    Attr a;
+    a.module = str();
+    a.parentClass = str();
+    a.isAttribute = u8();
+    for (auto n = uv(); n--;)
+      a.customAttr.insert(str());
+    return a;
+  }
+
+  ExprPtr expr() {
+    auto tag = u8();
+    if (tag == T_NULL)
+      return nullptr;
+
+    auto info = src();
+    auto flags = u8();
+    auto staticType = StaticValue::Type(u8());
+    StaticValue staticValue(staticType);
+    staticValue.evaluated = u8();
+    if (staticValue.evaluated) {
+      if (staticValue.type == StaticValue::INT)
+        staticValue.value = sv();
+      else if (staticValue.type == StaticValue::STRING)
+        staticValue.value = str();
+    }
+
+    ExprPtr e;
+    switch (tag) {
+    case T_NONE:
+      e = make_shared<NoneExpr>();
+      break;
+    case T_BOOL:
+      e = make_shared<BoolExpr>(bool(u8()));
+      break;
+    case T_INT: {
+      auto value = str();
+      auto n = make_shared<IntExpr>(value, str());
+      n->intValue = sv();
+      e = n;
+      break;
+    }
+    case T_FLOAT: {
+      auto value = str();
+      auto n = make_shared<FloatExpr>(value, str());
+      n->floatValue = f64();
+      e = n;
+      break;
+    }
+    case T_STRING: {
+      vector<pair<string, string>> strings;
+      for (auto n = uv(); n--;) {
+        auto value = str();
+        strings.emplace_back(value, str());
+      }
+      e = make_shared<StringExpr>(strings);
+      break;
+    }
+    case T_ID:
+      e = make_shared<IdExpr>(str());
+      break;
+    case T_STAR:
+      e = make_shared<StarExpr>(expr());
+      break;
+    case T_KWSTAR:
+      e = make_shared<KeywordStarExpr>(expr());
+      break;
+    case T_TUPLE:
+      e = make_shared<TupleExpr>(exprs());
+      break;
+    case T_LIST:
+      e = make_shared<ListExpr>(exprs());
+      break;
+    case T_SET:
+      e = make_shared<SetExpr>(exprs());
+      break;
+    case T_DICT: {
+      vector<DictExpr::DictItem> items;
+      for (auto n = uv(); n--;) {
+        auto key = expr();
+        items.push_back({key, expr()});
+      }
+      e = make_shared<DictExpr>(items);
+      break;
+    }
+    case T_GENERATOR: {
+      auto kind = GeneratorExpr::GeneratorKind(u8());
+      auto body = expr();
+      e = make_shared<GeneratorExpr>(kind, body, loops());
+      break;
+    }
+    case T_DICT_GENERATOR: {
+      auto key = expr();
+      auto body = expr();
+      e = make_shared<DictGeneratorExpr>(key, body, loops());
+      break;
+    }
+    case T_IF: {
+      auto cond = expr();
+      auto ifexpr = expr();
+      e = make_shared<IfExpr>(cond, ifexpr, expr());
+      break;
+    }
+    case T_UNARY: {
+      auto op = str();
+      e = make_shared<UnaryExpr>(op, expr());
+      break;
+    }
+    case T_BINARY: {
+      auto op = str();
+      auto lexpr = expr();
+      auto rexpr = expr();
+      e = make_shared<BinaryExpr>(lexpr, op, rexpr, bool(u8()));
+      break;
+    }
+    case T_CHAIN_BINARY: {
+      vector<pair<string, ExprPtr>> items;
+      for (auto n = uv(); n--;) {
+        auto op = str();
+        items.emplace_back(op, expr());
+      }
+      e = make_shared<ChainBinaryExpr>(items);
+      break;
+    }
+    case T_PIPE: {
+      vector<PipeExpr::Pipe> items;
+      for (auto n = uv(); n--;) {
+        auto op = str();
+        items.push_back({op, expr()});
+      }
+      e = make_shared<PipeExpr>(items);
+      break;
+    }
+    case T_INDEX: {
+      auto base = expr();
+      e = make_shared<IndexExpr>(base, expr());
+      break;
+    }
+    case T_CALL: {
+      auto callee = expr();
+      auto n = make_shared<CallExpr>(callee, args());
+      n->ordered = u8();
+      e = n;
+      break;
+    }
+    case T_DOT: {
+      auto base = expr();
+      e = make_shared<DotExpr>(base, str());
+      break;
+    }
+    case T_SLICE: {
+      auto start = expr();
+      auto stop = expr();
+      e = make_shared<SliceExpr>(start, stop, expr());
+      break;
+    }
+    case T_ELLIPSIS:
+      e = make_shared<EllipsisExpr>(bool(u8()));
+      break;
+    case T_LAMBDA: {
+      auto vars = strs();
+      e = make_shared<LambdaExpr>(vars, expr());
+      break;
+    }
+    case T_YIELD:
+      e = make_shared<YieldExpr>();
+      break;
+    case T_ASSIGN_EXPR: {
+      auto var = expr();
+      e = make_shared<AssignExpr>(var, expr());
+      break;
+    }
+    case T_RANGE: {
+      auto start = expr();
+      e = make_shared<RangeExpr>(start, expr());
+      break;
+    }
+    default:
+      throw SnapshotError();
+    }
+    e->setSrcInfo(info);
+    e->isTypeExpr = flags & 1;
+    e->done = flags & 2;
+    e->staticValue = staticValue;
+    return e;
+  }
+
+  StmtPtr stmt() {
+    auto tag = u8();
+    if (tag == T_NULL)
+      return nullptr;
+
+    auto info = src();
+    auto done = bool(u8());
+    auto age = int(sv());
+
+    StmtPtr s;
+    switch (tag) {
+    case T_SUITE: {
+      // Do not use the flattening constructor: keep the snapshot structure intact.
+      auto n = make_shared<SuiteStmt>();
+      for (auto k = uv(); k--;)
+        n->stmts.push_back(stmt());
+      n->ownBlock = u8();
+      s = n;
+      break;
+    }
+    case T_BREAK:
+      s = make_shared<BreakStmt>();
+      break;
+    case T_CONTINUE:
+      s = make_shared<ContinueStmt>();
+      break;
+    case T_EXPR_STMT:
+      s = make_shared<ExprStmt>(expr());
+      break;
+    case T_ASSIGN: {
+      auto lhs = expr();
+      auto rhs = expr();
+      auto type = expr();
+      s = make_shared<AssignStmt>(lhs, rhs, type, bool(u8()));
+      break;
+    }
+    case T_DEL:
+      s = make_shared<DelStmt>(expr());
+      break;
+    case T_PRINT: {
+      auto items = exprs();
+      s = make_shared<PrintStmt>(items, bool(u8()));
+      break;
+    }
+    case T_RETURN:
+      s = make_shared<ReturnStmt>(expr());
+      break;
+    case T_YIELD_STMT:
+      s = make_shared<YieldStmt>(expr());
+      break;
+    case T_ASSERT: {
+      auto e = expr();
+      s = make_shared<AssertStmt>(e, expr());
+      break;
+    }
+    case T_WHILE: {
+      auto cond = expr();
+      auto suite = stmt();
+      s = make_shared<WhileStmt>(cond, suite, stmt());
+      break;
+    }
+    case T_FOR: {
+      auto var = expr();
+      auto iter = expr();
+      auto suite = stmt();
+      auto elseSuite = stmt();
+      auto decorator = expr();
+      auto n = make_shared<ForStmt>(var, iter, suite, elseSuite, decorator, args());
+      n->wrapped = u8();
+      s = n;
+      break;
+    }
+    case T_IF_STMT: {
+      auto cond = expr();
+      auto ifSuite = stmt();
+      s = make_shared<IfStmt>(cond, ifSuite, stmt());
+      break;
+    }
+    case T_MATCH: {
+      auto what = expr();
+      vector<MatchStmt::MatchCase> cases;
+      for (auto n = uv(); n--;) {
+        auto pattern = expr();
+        auto guard = expr();
+        cases.push_back({pattern, guard, stmt()});
+      }
+      s = make_shared<MatchStmt>(what, cases);
+      break;
+    }
+    case T_IMPORT: {
+      auto from = expr();
+      auto what = expr();
+      auto as = str();
+      auto dots = int(sv());
+      auto ps = params();
+      s = make_shared<ImportStmt>(from, what, ps, expr(), as, dots);
+      break;
+    }
+    case T_TRY: {
+      auto suite = stmt();
+      vector<TryStmt::Catch> catches;
+      for (auto n = uv(); n--;) {
+        auto var = str();
+        auto exc = expr();
+        catches.push_back({var, exc, stmt()});
+      }
+      s = make_shared<TryStmt>(suite, catches, stmt());
+      break;
+    }
+    case T_GLOBAL:
+      s = make_shared<GlobalStmt>(str());
+      break;
+    case T_THROW: {
+      auto e = expr();
+      s = make_shared<ThrowStmt>(e, bool(u8()));
+      break;
+    }
+    case T_FUNCTION: {
+      auto name = str();
+      auto ret = expr();
+      auto ps = params();
+      auto suite = stmt();
+      auto attributes = attr();
+      s = make_shared<FunctionStmt>(name, ret, ps, suite, attributes, exprs());
+      break;
+    }
+    case T_CLASS: {
+      auto name = str();
+      auto ps = params();
+      auto suite = stmt();
+      auto attributes = attr();
+      auto decorators = exprs();
+      s = make_shared<ClassStmt>(name, ps, suite, attributes, decorators, exprs());
+      break;
+    }
+    case T_YIELD_FROM:
+      s = make_shared<YieldFromStmt>(expr());
+      break;
+    case T_WITH: {
+      auto items = exprs();
+      auto vars = strs();
+      s = make_shared<WithStmt>(items, vars, stmt());
+      break;
+    }
+    case T_CUSTOM: {
+      auto keyword = str();
+      auto e = expr();
+      s = make_shared<CustomStmt>(keyword, e, stmt());
+      break;
+    }
+    default:
+      throw SnapshotError();
+    }
+    s->setSrcInfo(info);
+    s->done = done;
+    s->age = age;
+    return s;
+  }
+};
+
+void writeU64(std::ostream &out, uint64_t v) {
+  char buf[8];
+  for (int i = 0; i < 8; i++)
+    buf[i] = char((v >> (8 * i)) & 0xff);
+  out.write(buf, 8);
+}
+
+uint64_t readU64(const char *p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++)
+    v |= uint64_t(uint8_t(p[i])) << (8 * i);
+  return v;
+}
+
+/// Header: magic, version, entry count; then one (hash, size, offset, length) record
+/// per entry; then the entries, each being the source code (size bytes) followed by
+/// its serialized AST.
+const size_t HEADER_SIZE = 8 + 8 + 8;
+const size_t RECORD_SIZE = 4 * 8;
+
+} // namespace
+
+Snapshot::Snapshot() : data(nullptr), size(0), entries() {}
+
+Snapshot::~Snapshot() {
+  if (data)
+    munmap(const_cast<char *>(data), size);
+}
+
+shared_ptr<Snapshot> Snapshot::open(const string &argv0) {
+  if (auto c = getenv("SEQ_SNAPSHOT"))
+    return openFile(c);
+  if (argv0.empty())
+    return nullptr;
+  char abs[PATH_MAX + 1];
+  strncpy(abs, executable_path(argv0.c_str()).c_str(), PATH_MAX);
+  string dir = dirname(abs);
+  for (auto loci : {"stdlib.snap", "../lib/seq/stdlib.snap"})
+    if (auto s = openFile(format("{}/{}", dir, loci)))
+      return s;
+  return nullptr;
+}
+
+shared_ptr<Snapshot> Snapshot::openFile(const string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) || size_t(st.st_size) < HEADER_SIZE) {
+    close(fd);
+    return nullptr;
+  }
+  void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    return nullptr;
+
+  auto s = make_shared<Snapshot>();
+  s->data = (const char *)mem;
+  s->size = st.st_size;
+  if (memcmp(s->data, SNAPSHOT_MAGIC, 8) != 0 ||
+      readU64(s->data + 8) != SNAPSHOT_VERSION)
+    return nullptr;
+  auto count = readU64(s->data + 16);
+  if (count > (s->size - HEADER_SIZE) / RECORD_SIZE)
+    return nullptr;
+  for (uint64_t i = 0; i < count; i++) {
+    auto r = s->data + HEADER_SIZE + i * RECORD_SIZE;
+    auto offset = readU64(r + 16), length = readU64(r + 24);
+    auto codeSize = readU64(r + 8);
+    if (offset > s->size || length > s->size - offset || codeSize > length)
+      return nullptr;
+    s->entries.insert({{readU64(r), codeSize}, {offset, length}});
+  }
+  return s;
+}
+
+StmtPtr Snapshot::load(const shared_ptr<Cache> &cache, const string &file,
+                       const string &code) const {
+  // Custom (DSL) keywords change how the code is parsed.
+  if (!cache->customBlockStmts.empty() || !cache->customExprStmts.empty())
+    return nullptr;
+  // The hash only narrows the search; the stored source must match byte for byte.
+  auto range = entries.equal_range({contentHash(code), code.size()});
+  for (auto it = range.first; it != range.second; ++it) {
+    auto begin = data + it->second.first, end = begin + it->second.second;
+    if (memcmp(begin, code.data(), code.size()) != 0)
+      continue;
+    try {
+      SnapshotReader reader(begin + code.size(), end, file);
+      return reader.stmt();
+    } catch (SnapshotError &) {
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+void Snapshot::write(const string &path, const vector<Entry> &files) {
+  vector<string> blobs;
+  for (auto &f : files) {
+    blobs.push_back(f.code);
+    SnapshotWriter(blobs.back(), f.file).stmt(f.ast.get());
+  }
+
+  std::ofstream fout(path, std::ios::binary);
+  if (!fout)
+    ast::error(format("cannot open {}", path).c_str());
+  fout.write(SNAPSHOT_MAGIC, 8); // includes the terminating NUL
+  writeU64(fout, SNAPSHOT_VERSION);
+  writeU64(fout, files.size());
+  uint64_t offset = HEADER_SIZE + files.size() * RECORD_SIZE;
+  for (size_t i = 0; i < files.size(); i++) {
+    writeU64(fout, contentHash(files[i].code));
+    writeU64(fout, files[i].code.size());
+    writeU64(fout, offset);
+    writeU64(fout, blobs[i].size());
+    offset += blobs[i].size();
+  }
+  for (auto &b : blobs)
+    fout.write(b.data(), b.size());
+  if (!fout)
+    ast::error(format("cannot write {}", path).c_str());
+}
+
+} // namespace ast
+} // namespace seq
@@ -0,0 +1,74 @@
+/*
+ * snapshot.h --- Binary snapshots of pre-parsed Seq source files.
+ *
+ * (c) Seq project. All rights reserved.
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "parser/ast.h"
+#include "parser/common.h"
+
+namespace seq {
+namespace ast {
+
+struct Cache;
+
+/**
+ * A read-only, memory-mapped snapshot of parsed (not yet simplified) ASTs.
+ * Generated at build time for the standard library so that the parser does not have
+ * to re-parse it on every invocation.
+ * Entries are keyed on the exact contents of a source file, so a snapshot never hides
+ * local modifications: a file that changed since the snapshot was taken is simply
+ * parsed from source.
+ */
+class Snapshot {
+  /// Mapped snapshot file.
+  const char *data;
+  size_t size;
+  /// Maps (content hash, content size) to the (offset, size) of an entry, i.e. of the
+  /// source code followed by its serialized AST.
+  std::multimap<pair<uint64_t, uint64_t>, pair<uint64_t, uint64_t>> entries;
+
+public:
+  /// A snapshot entry: file name, its source code and its parsed AST.
+  struct Entry {
+    string file;
+    string code;
+    StmtPtr ast;
+  };
+
+  Snapshot();
+  ~Snapshot();
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+
+  /// Map the snapshot of a seqc executable (whose argv0 is known).
+  /// Looks at $SEQ_SNAPSHOT first, and then at stdlib.snap next to the executable.
+  /// @return Snapshot pointer or nullptr if no valid snapshot is found.
+  static shared_ptr<Snapshot> open(const string &argv0);
+  /// Map a given snapshot file.
+  /// @return Snapshot pointer or nullptr if the file is not a valid snapshot.
+  static shared_ptr<Snapshot> openFile(const string &path);
+
+  /// Load a pre-parsed AST of a file whose source code is code.
+  /// @return Parsed AST or nullptr if the file is not in the snapshot.
+  StmtPtr load(const shared_ptr<Cache> &cache, const string &file,
+               const string &code) const;
+
+  /// Serialize ASTs of the given files into a snapshot file.
+  /// Throws a ParserException if a node cannot be serialized.
+  static void write(const string &path, const vector<Entry> &files);
+};
+
+} // namespace ast
+} // namespace seq
@@ -19,6 +19,7 @@
 #include "parser/visitors/typecheck/typecheck.h"
 
 #include "sir/types/types.h"
+#include "util/stats.h"
 
 using fmt::format;
 using std::deque;
@@ -129,10 +130,11 @@ types::TypePtr TypecheckVisitor::realizeFunc(types::FuncType *type) {
   seqassert(type->canRealize(), "{} not realizable", type->toString());
 
   try {
-    auto it =
-        ctx->cache->functions[type->ast->name].realizations.find(type->realizedName());
+    auto realizedName = type->realizedName();
+    auto it = ctx->cache->functions[type->ast->name].realizations.find(realizedName);
     if (it != ctx->cache->functions[type->ast->name].realizations.end())
       return it->second->type;
+    CompileStats::Timer timer("realize", realizedName);
 
     // Set up bases. Ensure that we have proper parent bases even during a realization
     // of mutually recursive functions.
@@ -10,6 +10,8 @@ const Result *Analysis::doGetAnalysis(const std::string &key) {
   return manager ? manager->getAnalysisResult(key) : nullptr;
 }
 
+unsigned Analysis::getThreads() const { return manager ? manager->getThreads() : 1; }
+
 } // namespace analyze
 } // namespace ir
 } // namespace seq
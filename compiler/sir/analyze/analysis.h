@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <unordered_set>
 
 #include "sir/module.h"
 #include "sir/transform/pass.h"
@@ -28,6 +29,18 @@ public:
   /// Execute the analysis.
   /// @param module the module
   virtual std::unique_ptr<Result> run(const Module *module) = 0;
+  /// Execute the analysis, reusing a previous result for the functions that were
+  /// not modified since it was computed. Analyses that cannot be updated
+  /// incrementally recompute the whole result.
+  /// @param module the module
+  /// @param previous the previous result
+  /// @param modified ids of the functions modified since the previous result
+  /// @return the result
+  virtual std::unique_ptr<Result> update(const Module *module,
+                                         std::unique_ptr<Result> previous,
+                                         const std::unordered_set<id_t> &modified) {
+    return run(module);
+  }
 
   /// Sets the manager.
   /// @param mng the new manager
@@ -38,6 +51,8 @@ public:
   const AnalysisType *getAnalysisResult(const std::string &key) {
     return static_cast<const AnalysisType *>(doGetAnalysis(key));
   }
+  /// @return the number of threads to analyze different functions with
+  unsigned getThreads() const;
 
 private:
   const analyze::Result *doGetAnalysis(const std::string &key);
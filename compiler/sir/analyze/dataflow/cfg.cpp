@@ -4,6 +4,7 @@
 
 #include "sir/dsl/codegen.h"
 #include "sir/dsl/nodes.h"
+#include "sir/util/concurrency.h"
 
 namespace seq {
 namespace ir {
@@ -133,17 +134,34 @@ std::unique_ptr<CFGraph> buildCFGraph(const BodiedFunc *f) {
 const std::string CFAnalysis::KEY = "core-analyses-cfg";
 
 std::unique_ptr<Result> CFAnalysis::run(const Module *m) {
-  auto res = std::make_unique<CFResult>();
-  if (const auto *main = cast<BodiedFunc>(m->getMainFunc())) {
-    res->graphs.insert(std::make_pair(main->getId(), buildCFGraph(main)));
+  return update(m, std::make_unique<CFResult>(), {});
+}
+
+std::unique_ptr<Result> CFAnalysis::update(const Module *m,
+                                           std::unique_ptr<Result> previous,
+                                           const std::unordered_set<id_t> &modified) {
+  // graphs of unmodified functions are kept in place, so that reaching definition
+  // inspectors built on them stay valid
+  auto *res = static_cast<CFResult *>(previous.get());
+  std::unordered_map<id_t, std::unique_ptr<CFGraph>> graphs;
+  std::vector<const BodiedFunc *> funcs;
+  for (auto *f : util::getBodiedFuncs(m)) {
+    auto it = res->graphs.find(f->getId());
+    if (it != res->graphs.end() && modified.find(f->getId()) == modified.end())
+      graphs.emplace(f->getId(), std::move(it->second));
+    else
+      funcs.push_back(f);
   }
 
-  for (const auto *var : *m) {
-    if (const auto *f = cast<BodiedFunc>(var)) {
-      res->graphs.insert(std::make_pair(f->getId(), buildCFGraph(f)));
-    }
+  std::vector<std::unique_ptr<CFGraph>> built(funcs.size());
+  util::parallelFor(funcs.size(), getThreads(), [&](unsigned, std::size_t i) {
+    built[i] = buildCFGraph(funcs[i]);
+  });
+  for (std::size_t i = 0; i < funcs.size(); i++) {
+    graphs.emplace(funcs[i]->getId(), std::move(built[i]));
   }
-  return res;
+  res->graphs = std::move(graphs);
+  return previous;
 }
 
 void CFVisitor::visit(const BodiedFunc *f) {
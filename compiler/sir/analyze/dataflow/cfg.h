@@ -417,6 +417,8 @@ public:
   std::string getKey() const override { return KEY; }
 
   std::unique_ptr<Result> run(const Module *m) override;
+  std::unique_ptr<Result> update(const Module *m, std::unique_ptr<Result> previous,
+                                 const std::unordered_set<id_t> &modified) override;
 };
 
 class CFVisitor : public util::ConstVisitor {
@@ -1,5 +1,10 @@
 #include "reaching.h"
 
+#include <utility>
+#include <vector>
+
+#include "sir/util/concurrency.h"
+
 namespace seq {
 namespace ir {
 namespace {
@@ -136,13 +141,39 @@ const std::string RDAnalysis::KEY = "core-analyses-rd";
 
 std::unique_ptr<Result> RDAnalysis::run(const Module *m) {
   auto *cfgResult = getAnalysisResult<CFResult>(cfAnalysisKey);
-  auto ret = std::make_unique<RDResult>(cfgResult);
+  return update(m, std::make_unique<RDResult>(cfgResult), {});
+}
+
+std::unique_ptr<Result> RDAnalysis::update(const Module *m,
+                                           std::unique_ptr<Result> previous,
+                                           const std::unordered_set<id_t> &modified) {
+  auto *cfgResult = getAnalysisResult<CFResult>(cfAnalysisKey);
+  auto *res = static_cast<RDResult *>(previous.get());
+  // inspectors can only be reused if the graphs were updated in place
+  if (res->cfgResult != cfgResult)
+    return run(m);
+
+  std::unordered_map<id_t, std::unique_ptr<RDInspector>> results;
+  std::vector<std::pair<id_t, CFGraph *>> graphs;
   for (const auto &graph : cfgResult->graphs) {
-    auto inspector = std::make_unique<RDInspector>(graph.second.get());
-    inspector->analyze();
-    ret->results[graph.first] = std::move(inspector);
+    auto it = res->results.find(graph.first);
+    if (it != res->results.end() && it->second->getGraph() == graph.second.get() &&
+        modified.find(graph.first) == modified.end())
+      results.emplace(graph.first, std::move(it->second));
+    else
+      graphs.emplace_back(graph.first, graph.second.get());
+  }
+
+  std::vector<std::unique_ptr<RDInspector>> inspectors(graphs.size());
+  util::parallelFor(graphs.size(), getThreads(), [&](unsigned, std::size_t i) {
+    inspectors[i] = std::make_unique<RDInspector>(graphs[i].second);
+    inspectors[i]->analyze();
+  });
+  for (std::size_t i = 0; i < graphs.size(); i++) {
+    results.emplace(graphs[i].first, std::move(inspectors[i]));
   }
-  return ret;
+  res->results = std::move(results);
+  return previous;
 }
 
 } // namespace dataflow
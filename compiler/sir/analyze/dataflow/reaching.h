@@ -32,6 +32,9 @@ public:
   /// Do the analysis.
   void analyze();
 
+  /// @return the control-flow graph
+  const CFGraph *getGraph() const { return cfg; }
+
   /// Gets the reaching definitions at a particular location.
   /// @param var the variable being inspected
   /// @param loc the location
@@ -72,6 +75,8 @@ public:
   std::string getKey() const override { return KEY; }
 
   std::unique_ptr<Result> run(const Module *m) override;
+  std::unique_ptr<Result> update(const Module *m, std::unique_ptr<Result> previous,
+                                 const std::unordered_set<id_t> &modified) override;
 };
 
 } // namespace dataflow
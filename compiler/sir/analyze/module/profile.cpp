@@ -0,0 +1,77 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+
+#include "sir/util/irtools.h"
+
+namespace seq {
+namespace ir {
+namespace analyze {
+namespace module {
+
+uint64_t ProfileResult::getCount(const Func *f) const {
+  auto it = counts.find(f->getId());
+  return it != counts.end() ? it->second : 0;
+}
+
+bool ProfileResult::isHot(const Func *f) const {
+  return hotThreshold && getCount(f) >= hotThreshold;
+}
+
+const std::string ProfileAnalysis::KEY = "core-analyses-profile";
+
+std::unique_ptr<Result> ProfileAnalysis::run(const Module *m) {
+  auto reader = llvm::IndexedInstrProfReader::create(filename);
+  if (!reader) {
+    compilationWarning("could not read profile '" + filename +
+                       "': " + llvm::toString(reader.takeError()));
+    return std::make_unique<ProfileResult>(std::unordered_map<id_t, uint64_t>(), 0);
+  }
+
+  std::unordered_map<std::string, uint64_t> profileCounts;
+  for (const auto &record : **reader) {
+    auto &count = profileCounts[record.Name.str()];
+    for (auto c : record.Counts)
+      count = std::max(count, c);
+  }
+  auto hotThreshold = llvm::ProfileSummaryBuilder::getHotCountThreshold(
+      (*reader)->getSummary(/*UseCS=*/false).getDetailedSummary());
+
+  // Profile names are those LLVMVisitor gives the functions, qualified with the
+  // main source file if the function is not exported.
+  std::string sourceFile;
+  if (auto *srcInfo = m->getMainFunc()->getAttribute<SrcInfoAttribute>())
+    sourceFile = srcInfo->info.file;
+  std::vector<const BodiedFunc *> funcs = {cast<BodiedFunc>(m->getMainFunc())};
+  for (const auto *var : *m) {
+    if (const auto *f = cast<BodiedFunc>(var))
+      funcs.push_back(f);
+  }
+
+  std::unordered_map<id_t, uint64_t> counts;
+  for (const auto *f : funcs) {
+    if (!f)
+      continue;
+    auto linkage = util::hasAttribute(f, "std.internal.attributes.export")
+                       ? llvm::GlobalValue::ExternalLinkage
+                       : llvm::GlobalValue::PrivateLinkage;
+    auto it = profileCounts.find(
+        llvm::getPGOFuncName(f->referenceString(), linkage, sourceFile));
+    if (it != profileCounts.end())
+      counts.emplace(f->getId(), it->second);
+  }
+  LOG_IR("[{}] {} profiled functions, hot threshold {}", KEY, counts.size(),
+         hotThreshold);
+  return std::make_unique<ProfileResult>(std::move(counts), hotThreshold);
+}
+
+} // namespace module
+} // namespace analyze
+} // namespace ir
+} // namespace seq
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "sir/analyze/analysis.h"
+
+namespace seq {
+namespace ir {
+namespace analyze {
+namespace module {
+
+struct ProfileResult : public Result {
+  /// mapping of function ID to the largest block count in the profile
+  std::unordered_map<id_t, uint64_t> counts;
+  /// count at or above which a block is considered hot
+  uint64_t hotThreshold;
+
+  ProfileResult(std::unordered_map<id_t, uint64_t> counts, uint64_t hotThreshold)
+      : counts(std::move(counts)), hotThreshold(hotThreshold) {}
+
+  /// @param f the function to check
+  /// @return the largest block count of the function, or 0 if not profiled
+  uint64_t getCount(const Func *f) const;
+  /// @param f the function to check
+  /// @return true if the function contains a hot block
+  bool isHot(const Func *f) const;
+};
+
+/// Analysis that reads an LLVM instrumentation profile (as produced by
+/// "seqc build -profile-generate" and merged with llvm-profdata).
+class ProfileAnalysis : public Analysis {
+private:
+  /// the indexed profile file
+  std::string filename;
+
+public:
+  static const std::string KEY;
+
+  /// Constructs a profile analysis.
+  /// @param filename the indexed profile file
+  explicit ProfileAnalysis(std::string filename)
+      : Analysis(), filename(std::move(filename)) {}
+
+  std::string getKey() const override { return KEY; }
+
+  std::unique_ptr<Result> run(const Module *m) override;
+};
+
+} // namespace module
+} // namespace analyze
+} // namespace ir
+} // namespace seq
@@ -8,7 +8,7 @@
 namespace seq {
 namespace ir {
 
-id_t IdMixin::currentId = 0;
+std::atomic<id_t> IdMixin::currentId(0);
 
 void IdMixin::resetId() { currentId = 0; }
 
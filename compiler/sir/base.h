@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -26,7 +27,7 @@ class Module;
 class IdMixin {
 private:
   /// the global id counter
-  static id_t currentId;
+  static std::atomic<id_t> currentId;
 
 protected:
   /// the instance's id
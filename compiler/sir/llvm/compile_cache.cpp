@@ -0,0 +1,214 @@
+#include "compile_cache.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+
+#include "parser/cache.h"
+#include "util/common.h"
+
+#define STR_HELPER(x) #x
+#define STR(x) STR_HELPER(x)
+#define SEQ_CACHE_VERSION_STRING()                                                     \
+  ("seq-cache " STR(SEQ_VERSION_MAJOR) "." STR(SEQ_VERSION_MINOR) "." STR(             \
+      SEQ_VERSION_PATCH))
+
+namespace seq {
+namespace ir {
+namespace {
+std::string hashFile(const std::string &path) {
+  auto buf = llvm::MemoryBuffer::getFile(path);
+  if (!buf)
+    return "";
+  llvm::SHA1 hasher;
+  hasher.update((*buf)->getBuffer());
+  return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+/// Writes a file by way of a temporary file in the same directory and a rename,
+/// so that concurrent readers never observe a partially written file.
+template <typename WriteFn>
+bool writeAtomically(const std::string &path, WriteFn write) {
+  int fd;
+  llvm::SmallString<128> tmp;
+  if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, tmp))
+    return false;
+  llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  if (!write(tmp.str().str()) || llvm::sys::fs::rename(tmp, path)) {
+    llvm::sys::fs::remove(tmp);
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+CompilationCache::CompilationCache(std::string dir, const std::string &input,
+                                   std::vector<std::string> config)
+    : dir(std::move(dir)), key() {
+  llvm::SmallString<128> abs(input);
+  if (llvm::sys::fs::make_absolute(abs))
+    return;
+  auto inputHash = hashFile(abs.str().str());
+  if (inputHash.empty())
+    return;
+
+  std::sort(config.begin(), config.end());
+  llvm::SHA1 hasher;
+  hasher.update(SEQ_CACHE_VERSION_STRING());
+  hasher.update(llvm::sys::getProcessTriple());
+  for (const auto &c : config) {
+    hasher.update("\n");
+    hasher.update(c);
+  }
+  hasher.update("\n");
+  hasher.update(abs.str());
+  hasher.update("\n");
+  hasher.update(inputHash);
+  key = llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+std::string CompilationCache::getEntryDir() const {
+  llvm::SmallString<128> path(dir);
+  llvm::sys::path::append(path, key);
+  return path.str().str();
+}
+
+std::string CompilationCache::getManifestPath() const {
+  llvm::SmallString<128> path(getEntryDir());
+  llvm::sys::path::append(path, "deps");
+  return path.str().str();
+}
+
+std::string CompilationCache::getBitcodePath() const {
+  llvm::SmallString<128> path(getEntryDir());
+  llvm::sys::path::append(path, "module.bc");
+  return path.str().str();
+}
+
+std::string CompilationCache::lookup() const {
+  if (!isValid())
+    return "";
+  auto manifest = llvm::MemoryBuffer::getFile(getManifestPath());
+  if (!manifest)
+    return "";
+
+  // each line is "<sha1> <absolute path>"
+  llvm::SmallVector<llvm::StringRef, 64> lines;
+  (*manifest)->getBuffer().split(lines, '\n', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  if (lines.empty() || lines[0] != SEQ_CACHE_VERSION_STRING())
+    return "";
+  for (unsigned i = 1; i < lines.size(); i++) {
+    auto entry = lines[i].split(' ');
+    if (entry.second.empty() || hashFile(entry.second.str()) != entry.first)
+      return "";
+  }
+
+  auto bitcode = getBitcodePath();
+  return llvm::sys::fs::exists(bitcode) ? bitcode : "";
+}
+
+void CompilationCache::store(const Module *module, LLVMVisitor &visitor) const {
+  if (!isValid())
+    return;
+  if (auto err = llvm::sys::fs::create_directories(getEntryDir())) {
+    compilationWarning("could not create cache directory: " + err.message());
+    return;
+  }
+
+  std::map<std::string, std::string> deps;
+  if (auto cache = module->getCache()) {
+    for (const auto &import : cache->imports) {
+      const auto &file = import.second.filename;
+      if (file.empty() || deps.find(file) != deps.end())
+        continue;
+      auto hash = hashFile(file);
+      if (hash.empty())
+        return;
+      deps.emplace(file, hash);
+    }
+  }
+
+  // bitcode goes first: a manifest is only ever visible once its module is
+  auto ok = writeAtomically(getBitcodePath(), [&](const std::string &tmp) {
+    visitor.writeToBitcodeFile(tmp);
+    return true;
+  });
+  ok = ok && writeAtomically(getManifestPath(), [&](const std::string &tmp) {
+         std::error_code err;
+         llvm::raw_fd_ostream out(tmp, err, llvm::sys::fs::OF_Text);
+         if (err)
+           return false;
+         out << SEQ_CACHE_VERSION_STRING() << "\n";
+         for (const auto &dep : deps)
+           out << dep.second << " " << dep.first << "\n";
+         out.close();
+         return !out.has_error();
+       });
+  if (!ok)
+    compilationWarning("could not write cache entry in " + getEntryDir());
+}
+
+ModuleCache::ModuleCache(std::string dir, std::vector<std::string> config)
+    : dir(std::move(dir)), config() {
+  std::sort(config.begin(), config.end());
+  llvm::SHA1 hasher;
+  hasher.update(SEQ_CACHE_VERSION_STRING());
+  hasher.update(llvm::sys::getProcessTriple());
+  for (const auto &c : config) {
+    hasher.update("\n");
+    hasher.update(c);
+  }
+  this->config = llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+std::string ModuleCache::getEntryPath(const std::string &key) const {
+  // the prefix lets LLVM's cache pruning manage our entries too
+  llvm::SmallString<128> path(dir);
+  llvm::sys::path::append(path, "llvmcache-seq-" + key);
+  return path.str().str();
+}
+
+std::string ModuleCache::getKey(llvm::StringRef bitcode) const {
+  llvm::SHA1 hasher;
+  hasher.update(config);
+  hasher.update(bitcode);
+  return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> ModuleCache::lookup(const std::string &key) const {
+  auto buf = llvm::MemoryBuffer::getFile(getEntryPath(key), /*FileSize=*/-1,
+                                         /*RequiresNullTerminator=*/false);
+  return buf ? std::move(*buf) : nullptr;
+}
+
+void ModuleCache::store(const std::string &key, llvm::StringRef contents) const {
+  if (auto err = llvm::sys::fs::create_directories(dir)) {
+    compilationWarning("could not create cache directory: " + err.message());
+    return;
+  }
+  auto ok = writeAtomically(getEntryPath(key), [&](const std::string &tmp) {
+    std::error_code err;
+    llvm::raw_fd_ostream out(tmp, err, llvm::sys::fs::OF_None);
+    if (err)
+      return false;
+    out << contents;
+    out.close();
+    return !out.has_error();
+  });
+  if (!ok)
+    compilationWarning("could not write cache entry in " + dir);
+}
+
+void ModuleCache::prune() const {
+  llvm::pruneCache(dir, llvm::cantFail(llvm::parseCachePruningPolicy("")));
+}
+
+} // namespace ir
+} // namespace seq
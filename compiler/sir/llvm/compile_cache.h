@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sir/llvm/llvisitor.h"
+#include "sir/sir.h"
+
+namespace seq {
+namespace ir {
+
+/// On-disk, content-addressed cache of optimized LLVM bitcode. Entries are
+/// keyed on the input file's path and contents plus the compiler configuration
+/// (version, optimization mode, definitions etc.), and record the content hash
+/// of every transitively imported file so that stale entries are detected.
+class CompilationCache {
+private:
+  /// the cache directory
+  std::string dir;
+  /// the entry key, empty if the input cannot be cached
+  std::string key;
+
+  std::string getEntryDir() const;
+  std::string getManifestPath() const;
+  std::string getBitcodePath() const;
+
+public:
+  /// Constructs a compilation cache entry for a given input.
+  /// @param dir the cache directory
+  /// @param input the input file
+  /// @param config strings describing the compiler configuration
+  CompilationCache(std::string dir, const std::string &input,
+                   std::vector<std::string> config);
+
+  /// @return true if the input can be cached
+  bool isValid() const { return !key.empty(); }
+
+  /// Looks up the entry, checking that none of the files it was
+  /// built from have changed.
+  /// @return path to the cached bitcode, or empty string on a miss
+  std::string lookup() const;
+
+  /// Optimizes and stores a compiled module in the cache.
+  /// @param module the IR module, used to collect imported files
+  /// @param visitor the LLVM visitor that compiled the module
+  void store(const Module *module, LLVMVisitor &visitor) const;
+};
+
+/// On-disk cache of separately compiled modules, used for incremental builds.
+/// Entries are keyed on the bitcode they were compiled from plus the compiler
+/// configuration. The directory is shared with ThinLTO's cache of native objects
+/// and pruned with it.
+class ModuleCache {
+private:
+  /// the cache directory
+  std::string dir;
+  /// hash of the compiler configuration
+  std::string config;
+
+  std::string getEntryPath(const std::string &key) const;
+
+public:
+  /// Constructs a module cache.
+  /// @param dir the cache directory
+  /// @param config strings describing the compiler configuration
+  ModuleCache(std::string dir, std::vector<std::string> config);
+
+  /// @return the cache directory
+  const std::string &getDir() const { return dir; }
+
+  /// @param bitcode the bitcode a module is compiled from
+  /// @return the key of the module's entry
+  std::string getKey(llvm::StringRef bitcode) const;
+
+  /// Looks up an entry.
+  /// @param key the entry key
+  /// @return the cached contents, or nullptr on a miss
+  std::unique_ptr<llvm::MemoryBuffer> lookup(const std::string &key) const;
+
+  /// Stores an entry, warning on failure.
+  /// @param key the entry key
+  /// @param contents the contents to store
+  void store(const std::string &key, llvm::StringRef contents) const;
+
+  /// Removes old entries according to LLVM's default cache pruning policy.
+  void prune() const;
+};
+
+} // namespace ir
+} // namespace seq
@@ -1,15 +1,22 @@
 #include "llvisitor.h"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <set>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <unordered_set>
 #include <utility>
 
 #include "llvm/CodeGen/CommandFlags.h"
 
+#include "compile_cache.h"
 #include "coro/Coroutines.h"
+#include "multiversion.h"
 #include "sir/dsl/codegen.h"
 #include "util/common.h"
+#include "util/stats.h"
 
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
@@ -74,6 +81,16 @@ getTargetMachine(llvm::Triple triple, llvm::StringRef cpuStr,
       llvm::CodeGenOpt::Aggressive));
 }
 
+std::unique_ptr<llvm::TargetMachine> getTargetMachine(llvm::Module *module,
+                                                      const std::string &cpuStr,
+                                                      const std::string &featuresStr) {
+  llvm::Triple moduleTriple(module->getTargetTriple());
+  if (!moduleTriple.getArch())
+    return nullptr;
+  return getTargetMachine(moduleTriple, cpuStr, featuresStr,
+                          llvm::codegen::InitTargetOptionsFromCodeGenFlags(moduleTriple));
+}
+
 /**
  * Simple extension of LLVM's SectionMemoryManager which catches data section
  * allocations and registers them with the GC. This allows the GC to know not
@@ -191,6 +208,205 @@ void addCoroutineBranchSimplifier(const llvm::PassManagerBuilder &builder,
 char CoroBranchSimplifier::ID = 0;
 llvm::RegisterPass<CoroBranchSimplifier> X("coro-br-simpl",
                                            "Coroutine Branch Simplifier");
+
+void applyDebugTransformations(llvm::Module *module, bool debug) {
+  if (debug) {
+    // remove tail calls and fix linkage for stack traces
+    for (auto &f : *module) {
+      f.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      if (f.hasFnAttribute(llvm::Attribute::AttrKind::AlwaysInline)) {
+        f.removeFnAttr(llvm::Attribute::AttrKind::AlwaysInline);
+      }
+      f.addFnAttr(llvm::Attribute::AttrKind::NoInline);
+      f.setHasUWTable();
+      f.addFnAttr("no-frame-pointer-elim", "true");
+      f.addFnAttr("no-frame-pointer-elim-non-leaf");
+      f.addFnAttr("no-jump-tables", "false");
+
+      for (auto &block : f.getBasicBlockList()) {
+        for (auto &inst : block) {
+          if (auto *call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+            call->setTailCall(false);
+          }
+        }
+      }
+    }
+  } else {
+    llvm::StripDebugInfo(*module);
+  }
+}
+
+/// Runs the optimization pipeline on the given module.
+/// @param profileGenerate profile to be written by instrumented code, if any
+/// @param profileUse profile to optimize with, if any
+/// @return the target machine used, or nullptr if the module has no target
+std::unique_ptr<llvm::TargetMachine>
+optimizeModule(llvm::Module *module, bool debug, const std::string &cpu,
+               const std::string &features, bool vectorize = true,
+               const std::string &profileGenerate = "",
+               const std::string &profileUse = "") {
+  applyDebugTransformations(module, debug);
+
+  llvm::Triple moduleTriple(module->getTargetTriple());
+  std::string cpuStr, featuresStr;
+  llvm::TargetLibraryInfoImpl tlii(moduleTriple);
+
+  auto pm = std::make_unique<llvm::legacy::PassManager>();
+  auto fpm = std::make_unique<llvm::legacy::FunctionPassManager>(module);
+  pm->add(new llvm::TargetLibraryInfoWrapperPass(tlii));
+
+  auto machine = getTargetMachine(module, cpu, features);
+  if (machine) {
+    cpuStr = cpu;
+    featuresStr = features;
+  }
+
+  llvm::codegen::setFunctionAttributes(cpuStr, featuresStr, *module);
+  pm->add(llvm::createTargetTransformInfoWrapperPass(
+      machine ? machine->getTargetIRAnalysis() : llvm::TargetIRAnalysis()));
+  fpm->add(llvm::createTargetTransformInfoWrapperPass(
+      machine ? machine->getTargetIRAnalysis() : llvm::TargetIRAnalysis()));
+
+  if (machine) {
+    auto &ltm = dynamic_cast<llvm::LLVMTargetMachine &>(*machine);
+    llvm::Pass *tpc = ltm.createPassConfig(*pm);
+    pm->add(tpc);
+  }
+
+  unsigned optLevel = 3;
+  unsigned sizeLevel = 0;
+  llvm::PassManagerBuilder pmb;
+
+  if (!debug) {
+    pmb.OptLevel = optLevel;
+    pmb.SizeLevel = sizeLevel;
+    pmb.Inliner = llvm::createFunctionInliningPass(optLevel, sizeLevel, false);
+    pmb.DisableUnrollLoops = false;
+    pmb.LoopVectorize = vectorize;
+    pmb.SLPVectorize = vectorize;
+    // pmb.MergeFunctions = true;
+  } else {
+    pmb.OptLevel = 0;
+  }
+
+  if (!profileGenerate.empty()) {
+    pmb.EnablePGOInstrGen = true;
+    pmb.PGOInstrGen = profileGenerate;
+  }
+  pmb.PGOInstrUse = profileUse;
+
+  if (machine) {
+    machine->adjustPassManager(pmb);
+  }
+
+  coro::addCoroutinePassesToExtensionPoints(pmb);
+  if (!debug) {
+    pmb.addExtension(llvm::PassManagerBuilder::EP_LateLoopOptimizations,
+                     addCoroutineBranchSimplifier);
+  }
+
+  pmb.populateModulePassManager(*pm);
+  pmb.populateFunctionPassManager(*fpm);
+
+  fpm->doInitialization();
+  for (llvm::Function &f : *module) {
+    if (f.isDeclaration())
+      continue;
+    auto name = f.getName();
+    CompileStats::Timer timer("llvm-function", {name.data(), name.size()});
+    fpm->run(f);
+  }
+  fpm->doFinalization();
+  {
+    CompileStats::Timer timer("llvm", "module-passes");
+    pm->run(*module);
+  }
+  applyDebugTransformations(module, debug);
+  return machine;
+}
+
+/// Emits the given module as a native object file.
+void emitObjectFile(llvm::Module *module, llvm::TargetMachine *machine,
+                    llvm::raw_pwrite_stream &os) {
+  CompileStats::Timer timer("llvm", "codegen");
+  auto &llvmtm = static_cast<llvm::LLVMTargetMachine &>(*machine);
+  auto *mmiwp = new llvm::MachineModuleInfoWrapperPass(&llvmtm);
+  llvm::legacy::PassManager pm;
+
+  llvm::TargetLibraryInfoImpl tlii(llvm::Triple(module->getTargetTriple()));
+  pm.add(new llvm::TargetLibraryInfoWrapperPass(tlii));
+  seqassert(!machine->addPassesToEmitFile(pm, os, nullptr, llvm::CGFT_ObjectFile,
+                                          /*DisableVerify=*/true, mmiwp),
+            "could not add passes");
+  const_cast<llvm::TargetLoweringObjectFile *>(llvmtm.getObjFileLowering())
+      ->Initialize(mmiwp->getMMI().getContext(), *machine);
+  pm.run(*module);
+}
+
+/// Runs the given command and returns its exit status.
+int runCommand(const std::vector<std::string> &args) {
+  std::vector<const char *> cArgs;
+  for (auto &arg : args) {
+    cArgs.push_back(arg.c_str());
+  }
+  cArgs.push_back(nullptr);
+
+  if (fork() == 0) {
+    int status = execvp(cArgs[0], (char *const *)&cArgs[0]);
+    exit(status);
+  } else {
+    int status;
+    if (wait(&status) < 0) {
+      compilationError("process for '" + args[0] + "' encountered an error in wait");
+    }
+    return WEXITSTATUS(status);
+  }
+}
+
+void checkCommandStatus(const std::vector<std::string> &args, int status) {
+  if (status != 0) {
+    compilationError("process for '" + args[0] + "' exited with status " +
+                     std::to_string(status));
+  }
+}
+
+void executeCommand(const std::vector<std::string> &args) {
+  checkCommandStatus(args, runCommand(args));
+}
+
+/// Removes the given temporary object files if there is more than one, i.e. if they
+/// are partitions rather than the program's own object file.
+void removePartitionObjectFiles(const std::vector<std::string> &objFiles) {
+  if (objFiles.size() <= 1)
+    return;
+  for (const auto &objFile : objFiles)
+    llvm::sys::fs::remove(objFile);
+}
+
+void addEnvVarPathsToLinkerArgs(std::vector<std::string> &args,
+                                const std::string &var) {
+  if (const char *path = getenv(var.c_str())) {
+    llvm::StringRef pathStr(path);
+    llvm::SmallVector<llvm::StringRef, 16> split;
+    pathStr.split(split, ":");
+
+    for (const auto &subPath : split) {
+      args.push_back(("-L" + subPath).str());
+    }
+  }
+}
+
+/// Unwraps the result of an ORC operation, failing compilation on error.
+template <typename T> T orcCheck(llvm::Expected<T> result) {
+  if (!result)
+    compilationError(llvm::toString(result.takeError()));
+  return std::move(*result);
+}
+
+void orcCheck(llvm::Error err) {
+  if (err)
+    compilationError(llvm::toString(std::move(err)));
+}
 } // namespace
 
 llvm::DIFile *LLVMVisitor::DebugInfo::getFile(const std::string &path) {
@@ -210,7 +426,9 @@ llvm::DIFile *LLVMVisitor::DebugInfo::getFile(const std::string &path) {
 LLVMVisitor::LLVMVisitor(bool debug, const std::string &flags)
     : util::ConstVisitor(), context(), builder(context), module(), func(nullptr),
       block(nullptr), value(nullptr), vars(), funcs(), coro(), loops(), trycatch(),
-      db(debug, flags), machine() {
+      db(debug, flags), machine(), optimized(false), jobs(1),
+      cpu(llvm::codegen::getCPUStr()), features(llvm::codegen::getFeaturesStr()),
+      multiversion(false), profileGenerate(), profileUse(), cacheDir() {
   llvm::InitializeAllTargets();
   llvm::InitializeAllTargetMCs();
   llvm::InitializeAllAsmPrinters();
@@ -276,121 +494,79 @@ void LLVMVisitor::verify() {
 
 void LLVMVisitor::dump(const std::string &filename) { writeToLLFile(filename, false); }
 
-void LLVMVisitor::applyDebugTransformations() {
-  if (db.debug) {
-    // remove tail calls and fix linkage for stack traces
-    for (auto &f : *module) {
-      f.setLinkage(llvm::GlobalValue::ExternalLinkage);
-      if (f.hasFnAttribute(llvm::Attribute::AttrKind::AlwaysInline)) {
-        f.removeFnAttr(llvm::Attribute::AttrKind::AlwaysInline);
-      }
-      f.addFnAttr(llvm::Attribute::AttrKind::NoInline);
-      f.setHasUWTable();
-      f.addFnAttr("no-frame-pointer-elim", "true");
-      f.addFnAttr("no-frame-pointer-elim-non-leaf");
-      f.addFnAttr("no-jump-tables", "false");
-
-      for (auto &block : f.getBasicBlockList()) {
-        for (auto &inst : block) {
-          if (auto *call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
-            call->setTailCall(false);
-          }
-        }
-      }
-    }
-  } else {
-    llvm::StripDebugInfo(*module);
-  }
+void LLVMVisitor::runLLVMOptimizationPasses(bool firstRound) {
+  // Profiles are only generated or applied in the first round, since the
+  // instrumented and the profiled control flow graphs must match.
+  // With multiversioning, loops are vectorized only once they have been cloned.
+  CompileStats::Timer timer("llvm", "opt", firstRound ? 0 : 1);
+  machine = optimizeModule(module.get(), db.debug, cpu, features,
+                           /*vectorize=*/!(firstRound && multiversion),
+                           firstRound ? profileGenerate : "",
+                           firstRound ? profileUse : "");
 }
 
-void LLVMVisitor::runLLVMOptimizationPasses() {
-  applyDebugTransformations();
-
-  llvm::Triple moduleTriple(module->getTargetTriple());
-  std::string cpuStr, featuresStr;
-  const llvm::TargetOptions options =
-      llvm::codegen::InitTargetOptionsFromCodeGenFlags(moduleTriple);
-  llvm::TargetLibraryInfoImpl tlii(moduleTriple);
-
-  auto pm = std::make_unique<llvm::legacy::PassManager>();
-  auto fpm = std::make_unique<llvm::legacy::FunctionPassManager>(module.get());
-  pm->add(new llvm::TargetLibraryInfoWrapperPass(tlii));
-
-  if (moduleTriple.getArch()) {
-    cpuStr = llvm::codegen::getCPUStr();
-    featuresStr = llvm::codegen::getFeaturesStr();
-    machine = getTargetMachine(moduleTriple, cpuStr, featuresStr, options);
-  }
-
-  llvm::codegen::setFunctionAttributes(cpuStr, featuresStr, *module);
-  pm->add(llvm::createTargetTransformInfoWrapperPass(
-      machine ? machine->getTargetIRAnalysis() : llvm::TargetIRAnalysis()));
-  fpm->add(llvm::createTargetTransformInfoWrapperPass(
-      machine ? machine->getTargetIRAnalysis() : llvm::TargetIRAnalysis()));
-
-  if (machine) {
-    auto &ltm = dynamic_cast<llvm::LLVMTargetMachine &>(*machine);
-    llvm::Pass *tpc = ltm.createPassConfig(*pm);
-    pm->add(tpc);
-  }
-
-  unsigned optLevel = 3;
-  unsigned sizeLevel = 0;
-  llvm::PassManagerBuilder pmb;
-
-  if (!db.debug) {
-    pmb.OptLevel = optLevel;
-    pmb.SizeLevel = sizeLevel;
-    pmb.Inliner = llvm::createFunctionInliningPass(optLevel, sizeLevel, false);
-    pmb.DisableUnrollLoops = false;
-    pmb.LoopVectorize = true;
-    pmb.SLPVectorize = true;
-    // pmb.MergeFunctions = true;
-  } else {
-    pmb.OptLevel = 0;
-  }
-
-  if (machine) {
-    machine->adjustPassManager(pmb);
-  }
-
-  coro::addCoroutinePassesToExtensionPoints(pmb);
-  if (!db.debug) {
-    pmb.addExtension(llvm::PassManagerBuilder::EP_LateLoopOptimizations,
-                     addCoroutineBranchSimplifier);
-  }
-
-  pmb.populateModulePassManager(*pm);
-  pmb.populateFunctionPassManager(*fpm);
-
-  fpm->doInitialization();
-  for (llvm::Function &f : *module) {
-    fpm->run(f);
-  }
-  fpm->doFinalization();
-  pm->run(*module);
-  applyDebugTransformations();
+void LLVMVisitor::multiversionFunctions() {
+  if (!multiversion || db.debug)
+    return;
+  using namespace std::chrono;
+  CompileStats::Timer timer("llvm", "multiversion");
+  auto t = high_resolution_clock::now();
+  auto count = multiversionLoops(module.get());
+  LOG_TIME("[T] llvm/multiversion = {:.1f} ({} functions)",
+           duration_cast<milliseconds>(high_resolution_clock::now() - t).count() / 1000.0,
+           count);
 }
 
 void LLVMVisitor::runLLVMPipeline() {
+  if (optimized)
+    return;
   using namespace std::chrono;
   auto t = high_resolution_clock::now();
   verify();
-  runLLVMOptimizationPasses();
+  runLLVMOptimizationPasses(/*firstRound=*/true);
   LOG_TIME("[T] llvm/opt = {:.1f}",
            duration_cast<milliseconds>(high_resolution_clock::now() - t).count() /
                1000.0);
   if (!db.debug) {
+    multiversionFunctions();
     t = high_resolution_clock::now();
-    runLLVMOptimizationPasses();
+    runLLVMOptimizationPasses(/*firstRound=*/false);
     LOG_TIME("[T] llvm/opt2 = {:.1f}",
              duration_cast<milliseconds>(high_resolution_clock::now() - t).count() /
                  1000.0);
   }
   verify();
+  optimized = true;
+}
+
+bool LLVMVisitor::readBitcodeFile(const std::string &filename) {
+  auto buf = llvm::MemoryBuffer::getFile(filename);
+  if (!buf)
+    return false;
+  auto result = llvm::parseBitcodeFile((*buf)->getMemBufferRef(), context);
+  if (!result) {
+    llvm::consumeError(result.takeError());
+    return false;
+  }
+  module = std::move(*result);
+  optimized = true;
+  return true;
 }
 
 void LLVMVisitor::writeToObjectFile(const std::string &filename) {
+  const bool thinLTO = !cacheDir.empty() && !optimized && !db.debug;
+  if (jobs != 1 || thinLTO) {
+    // combine partitions into a single relocatable object
+    auto objFiles = thinLTO ? writeToThinLTOObjectFiles(filename)
+                            : writeToPartitionedObjectFiles(filename);
+    std::vector<std::string> command = {"ld", "-r", "-o", filename};
+    command.insert(command.end(), objFiles.begin(), objFiles.end());
+    auto status = runCommand(command);
+    removePartitionObjectFiles(objFiles);
+    checkCommandStatus(command, status);
+    return;
+  }
+
   runLLVMPipeline();
 
   std::error_code err;
@@ -398,21 +574,341 @@ void LLVMVisitor::writeToObjectFile(const std::string &filename) {
       std::make_unique<llvm::ToolOutputFile>(filename, err, llvm::sys::fs::OF_None);
   if (err)
     compilationError(err.message());
-  llvm::raw_pwrite_stream *os = &out->os();
+  emitObjectFile(module.get(), machine.get(), out->os());
+  out->keep();
+}
 
-  auto &llvmtm = static_cast<llvm::LLVMTargetMachine &>(*machine);
-  auto *mmiwp = new llvm::MachineModuleInfoWrapperPass(&llvmtm);
-  llvm::legacy::PassManager pm;
+std::vector<std::string>
+LLVMVisitor::writeToPartitionedObjectFiles(const std::string &filename) {
+  using namespace std::chrono;
+  // The first optimization round runs on the whole module so that inlining and other
+  // interprocedural optimizations see every function; the second (release-mode) round
+  // runs separately on each partition, together with code generation.
+  const bool reoptimize = !optimized && !db.debug;
+  if (!optimized) {
+    auto t = high_resolution_clock::now();
+    verify();
+    runLLVMOptimizationPasses(/*firstRound=*/true);
+    verify();
+    LOG_TIME("[T] llvm/opt = {:.1f}",
+             duration_cast<milliseconds>(high_resolution_clock::now() - t).count() /
+                 1000.0);
+    multiversionFunctions();
+    optimized = true;
+  }
 
-  llvm::TargetLibraryInfoImpl tlii(llvm::Triple(module->getTargetTriple()));
-  pm.add(new llvm::TargetLibraryInfoWrapperPass(tlii));
-  seqassert(!machine->addPassesToEmitFile(pm, *os, nullptr, llvm::CGFT_ObjectFile,
-                                          /*DisableVerify=*/true, mmiwp),
-            "could not add passes");
-  const_cast<llvm::TargetLoweringObjectFile *>(llvmtm.getObjFileLowering())
-      ->Initialize(mmiwp->getMMI().getContext(), *machine);
-  pm.run(*module);
-  out->keep();
+  auto t = high_resolution_clock::now();
+  const unsigned n =
+      jobs ? jobs : llvm::heavyweight_hardware_concurrency().compute_thread_count();
+  // partitions are passed to worker threads as bitcode, since each thread needs
+  // its own LLVM context
+  std::vector<llvm::SmallString<0>> partitions;
+  llvm::SplitModule(
+      llvm::CloneModule(*module), n,
+      [&](std::unique_ptr<llvm::Module> part) {
+        partitions.emplace_back();
+        llvm::raw_svector_ostream os(partitions.back());
+        llvm::WriteBitcodeToFile(*part, os);
+      },
+      /*PreserveLocals=*/false);
+
+  std::vector<std::string> objFiles;
+  for (unsigned i = 0; i < partitions.size(); i++)
+    objFiles.push_back(filename + "." + std::to_string(i) + ".o");
+  std::vector<std::string> errors(partitions.size());
+  {
+    llvm::ThreadPool pool(llvm::hardware_concurrency(n));
+    for (unsigned i = 0; i < partitions.size(); i++) {
+      pool.async([&, i]() {
+        llvm::LLVMContext partContext;
+        auto part = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(partitions[i].str(), objFiles[i]), partContext);
+        if (!part) {
+          errors[i] = llvm::toString(part.takeError());
+          return;
+        }
+        auto partMachine = reoptimize
+                               ? optimizeModule(part->get(), db.debug, cpu, features)
+                               : getTargetMachine(part->get(), cpu, features);
+        std::error_code err;
+        llvm::raw_fd_ostream out(objFiles[i], err, llvm::sys::fs::OF_None);
+        if (err) {
+          errors[i] = err.message();
+          return;
+        }
+        emitObjectFile(part->get(), partMachine.get(), out);
+      });
+    }
+    pool.wait();
+  }
+  for (const auto &error : errors) {
+    if (!error.empty())
+      compilationError(error);
+  }
+  LOG_TIME("[T] llvm/codegen ({} partitions) = {:.1f}", partitions.size(),
+           duration_cast<milliseconds>(high_resolution_clock::now() - t).count() /
+               1000.0);
+  return objFiles;
+}
+
+std::vector<std::string>
+LLVMVisitor::writeToThinLTOObjectFiles(const std::string &filename) {
+  using namespace std::chrono;
+  auto t = high_resolution_clock::now();
+  verify();
+
+  // Functions are grouped by the source file they were defined in; everything else
+  // goes to the first partition unless only one other partition uses it.
+  std::vector<std::string> sources = {""};
+  std::unordered_map<std::string, unsigned> sourceIndex = {{"", 0}};
+  std::unordered_map<const llvm::GlobalValue *, unsigned> partitionOf;
+  for (auto &f : *module) {
+    if (f.isDeclaration())
+      continue;
+    std::string source;
+    if (auto *sp = f.getSubprogram())
+      source = (sp->getDirectory() + "/" + sp->getFilename()).str();
+    auto it = sourceIndex.emplace(source, sources.size());
+    if (it.second)
+      sources.push_back(source);
+    partitionOf[&f] = it.first->second;
+  }
+
+  // Collects the partitions that (transitively) use a value. Local constants are
+  // not in partitionOf, as they are copied into every partition that uses them.
+  std::function<void(const llvm::Value *, std::set<unsigned> &,
+                     std::unordered_set<const llvm::Value *> &)>
+      collectUsers = [&](const llvm::Value *v, std::set<unsigned> &parts,
+                         std::unordered_set<const llvm::Value *> &seen) {
+        for (auto *user : v->users()) {
+          if (!seen.insert(user).second)
+            continue;
+          if (auto *inst = llvm::dyn_cast<llvm::Instruction>(user)) {
+            parts.insert(partitionOf.find(inst->getFunction())->second);
+          } else if (auto *gv = llvm::dyn_cast<llvm::GlobalValue>(user)) {
+            auto it = partitionOf.find(gv);
+            if (it != partitionOf.end())
+              parts.insert(it->second);
+            else
+              collectUsers(gv, parts, seen);
+          } else {
+            collectUsers(user, parts, seen);
+          }
+        }
+      };
+  auto usersOf = [&](const llvm::Value *v) {
+    std::set<unsigned> parts;
+    std::unordered_set<const llvm::Value *> seen;
+    collectUsers(v, parts, seen);
+    return parts;
+  };
+  auto isCopied = [](const llvm::GlobalVariable &g) {
+    return g.hasLocalLinkage() && g.isConstant() && !g.isDeclaration();
+  };
+
+  for (auto &g : module->globals()) {
+    if (g.isDeclaration() || isCopied(g))
+      continue;
+    auto parts = usersOf(&g);
+    partitionOf[&g] = (parts.size() == 1) ? *parts.begin() : 0;
+  }
+  for (auto &a : module->aliases())
+    partitionOf[&a] = 0;
+  std::unordered_map<const llvm::GlobalValue *, std::set<unsigned>> copiesOf;
+  for (auto &g : module->globals()) {
+    if (isCopied(g))
+      copiesOf[&g] = usersOf(&g);
+  }
+
+  // Local definitions used by other partitions need to be linked to. Partitions
+  // keep the whole program's source file name, and externalized functions are
+  // renamed to the PGO names they have as locals, so that profiles match those
+  // of non-incremental builds.
+  const std::string sourceFile = module->getSourceFileName();
+  auto externalizeIfShared = [&](llvm::GlobalValue &gv) {
+    auto it = partitionOf.find(&gv);
+    if (it == partitionOf.end() || !gv.hasLocalLinkage())
+      return;
+    auto parts = usersOf(&gv);
+    if (std::any_of(parts.begin(), parts.end(),
+                    [&](unsigned part) { return part != it->second; })) {
+      if (!gv.hasName())
+        gv.setName("seq.anon");
+      else if (llvm::isa<llvm::Function>(gv))
+        gv.setName(llvm::getPGOFuncName(gv.getName(), gv.getLinkage(), sourceFile));
+      gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      gv.setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
+  };
+  for (auto &f : *module)
+    externalizeIfShared(f);
+  for (auto &g : module->globals())
+    externalizeIfShared(g);
+  for (auto &a : module->aliases())
+    externalizeIfShared(a);
+  // debug info would make the partitions' contents depend on each other
+  llvm::StripDebugInfo(*module);
+
+  std::vector<std::string> config = {"cpu:" + cpu, "features:" + features};
+  if (multiversion)
+    config.push_back("multiversion");
+  if (!profileGenerate.empty())
+    config.push_back("profile-generate:" + profileGenerate);
+  if (!profileUse.empty()) {
+    auto profile = llvm::MemoryBuffer::getFile(profileUse);
+    if (!profile)
+      compilationError("could not read profile " + profileUse);
+    llvm::SHA1 hasher;
+    hasher.update((*profile)->getBuffer());
+    config.push_back("profile-use:" + llvm::toHex(hasher.final()));
+  }
+  ModuleCache cache(cacheDir, config);
+
+  std::vector<llvm::SmallString<0>> partitions(sources.size());
+  std::vector<std::string> keys(sources.size());
+  for (unsigned i = 0; i < sources.size(); i++) {
+    llvm::ValueToValueMapTy vmap;
+    auto part = llvm::CloneModule(*module, vmap, [&](const llvm::GlobalValue *gv) {
+      auto it = copiesOf.find(gv);
+      if (it != copiesOf.end())
+        return it->second.count(i) > 0;
+      auto jt = partitionOf.find(gv);
+      return (jt != partitionOf.end() ? jt->second : 0) == i;
+    });
+    for (auto &g : llvm::make_early_inc_range(part->globals())) {
+      if (g.isDeclaration() && g.getName().startswith("llvm.") && g.use_empty())
+        g.eraseFromParent();
+    }
+    part->setModuleIdentifier(sources[i].empty() ? "<internal>" : sources[i]);
+    part->setSourceFileName(sourceFile);
+    llvm::raw_svector_ostream os(partitions[i]);
+    llvm::WriteBitcodeToFile(*part, os);
+    keys[i] = cache.getKey(partitions[i]);
+  }
+
+  // optimize each partition on its own, unless it is cached, and summarize it for
+  // ThinLTO
+  const unsigned n =
+      jobs ? jobs : llvm::heavyweight_hardware_concurrency().compute_thread_count();
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> summarized(sources.size());
+  std::vector<std::string> errors(sources.size());
+  std::atomic<unsigned> misses(0);
+  {
+    llvm::ThreadPool pool(llvm::hardware_concurrency(n));
+    for (unsigned i = 0; i < sources.size(); i++) {
+      pool.async([&, i]() {
+        if ((summarized[i] = cache.lookup(keys[i])))
+          return;
+        ++misses;
+        llvm::LLVMContext partContext;
+        auto part = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(partitions[i].str(), sources[i]), partContext);
+        if (!part) {
+          errors[i] = llvm::toString(part.takeError());
+          return;
+        }
+        // with multiversioning, loops are vectorized after ThinLTO
+        optimizeModule(part->get(), /*debug=*/false, cpu, features,
+                       /*vectorize=*/!multiversion, profileGenerate, profileUse);
+        if (multiversion)
+          multiversionLoops(part->get());
+        llvm::SmallString<0> bitcode;
+        llvm::raw_svector_ostream os(bitcode);
+        auto index = llvm::buildModuleSummaryIndex(**part, nullptr, nullptr);
+        llvm::WriteBitcodeToFile(**part, os, /*ShouldPreserveUseListOrder=*/false,
+                                 &index, /*GenerateHash=*/true);
+        cache.store(keys[i], bitcode);
+        summarized[i] = llvm::MemoryBuffer::getMemBufferCopy(bitcode, sources[i]);
+      });
+    }
+    pool.wait();
+  }
+  for (const auto &error : errors) {
+    if (!error.empty())
+      compilationError(error);
+  }
+  LOG_TIME("[T] llvm/opt ({} of {} modules) = {:.1f}", misses.load(), sources.size(),
+           duration_cast<milliseconds>(high_resolution_clock::now() - t).count() /
+               1000.0);
+
+  t = high_resolution_clock::now();
+  llvm::lto::Config conf;
+  llvm::Triple triple(module->getTargetTriple());
+  conf.CPU = cpu;
+  conf.MAttrs = llvm::codegen::getMAttrs();
+  if (!features.empty()) {
+    llvm::SmallVector<llvm::StringRef, 8> attrs;
+    llvm::StringRef(features).split(attrs, ",", /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    conf.MAttrs.assign(attrs.begin(), attrs.end());
+  }
+  conf.Options = llvm::codegen::InitTargetOptionsFromCodeGenFlags(triple);
+  conf.RelocModel = llvm::codegen::getExplicitRelocModel();
+  conf.CodeModel = llvm::codegen::getExplicitCodeModel();
+  conf.CGOptLevel = llvm::CodeGenOpt::Aggressive;
+  conf.OptLevel = 3;
+  conf.DefaultTriple = triple.getTriple();
+
+  llvm::lto::LTO lto(std::move(conf),
+                     llvm::lto::createInProcessThinBackend(
+                         llvm::heavyweight_hardware_concurrency(jobs)));
+  for (unsigned i = 0; i < sources.size(); i++) {
+    auto input = llvm::lto::InputFile::create(summarized[i]->getMemBufferRef());
+    if (!input)
+      compilationError(llvm::toString(input.takeError()));
+    // every symbol is defined exactly once; only the original external symbols
+    // (e.g. main and exported functions) are referenced from outside
+    std::vector<llvm::lto::SymbolResolution> resolutions;
+    for (const auto &sym : (*input)->symbols()) {
+      llvm::lto::SymbolResolution res;
+      res.Prevailing = !sym.isUndefined();
+      res.FinalDefinitionInLinkageUnit = !sym.isUndefined();
+      res.VisibleToRegularObj =
+          sym.getVisibility() != llvm::GlobalValue::HiddenVisibility;
+      resolutions.push_back(res);
+    }
+    if (auto err = lto.add(std::move(*input), resolutions))
+      compilationError(llvm::toString(std::move(err)));
+  }
+
+  std::vector<std::string> objFiles(lto.getMaxTasks());
+  std::vector<std::string> objErrors(objFiles.size());
+  auto objFileFor = [&](unsigned task) {
+    objFiles[task] = filename + "." + std::to_string(task) + ".o";
+    return objFiles[task];
+  };
+  auto addStream = [&](unsigned task) {
+    std::error_code err;
+    auto os = std::make_unique<llvm::raw_fd_ostream>(objFileFor(task), err,
+                                                     llvm::sys::fs::OF_None);
+    if (err)
+      objErrors[task] = err.message();
+    return std::make_unique<llvm::lto::NativeObjectStream>(std::move(os));
+  };
+  auto objCache = llvm::lto::localCache(
+      cache.getDir(), [&](unsigned task, std::unique_ptr<llvm::MemoryBuffer> mb) {
+        std::error_code err;
+        llvm::raw_fd_ostream os(objFileFor(task), err, llvm::sys::fs::OF_None);
+        if (err)
+          objErrors[task] = err.message();
+        else
+          os << mb->getBuffer();
+      });
+  if (!objCache)
+    compilationError(llvm::toString(objCache.takeError()));
+  if (auto err = lto.run(addStream, *objCache))
+    compilationError(llvm::toString(std::move(err)));
+  for (const auto &error : objErrors) {
+    if (!error.empty())
+      compilationError(error);
+  }
+  cache.prune();
+  LOG_TIME("[T] llvm/thinlto = {:.1f}",
+           duration_cast<milliseconds>(high_resolution_clock::now() - t).count() /
+               1000.0);
+
+  // the regular LTO task produces no object if all modules are ThinLTO modules
+  objFiles.erase(std::remove(objFiles.begin(), objFiles.end(), ""), objFiles.end());
+  return objFiles;
 }
 
 void LLVMVisitor::writeToBitcodeFile(const std::string &filename) {
@@ -434,48 +930,17 @@ void LLVMVisitor::writeToLLFile(const std::string &filename, bool optimize) {
   fout.close();
 }
 
-namespace {
-void executeCommand(const std::vector<std::string> &args) {
-  std::vector<const char *> cArgs;
-  for (auto &arg : args) {
-    cArgs.push_back(arg.c_str());
-  }
-  cArgs.push_back(nullptr);
-
-  if (fork() == 0) {
-    int status = execvp(cArgs[0], (char *const *)&cArgs[0]);
-    exit(status);
-  } else {
-    int status;
-    if (wait(&status) < 0) {
-      compilationError("process for '" + args[0] + "' encountered an error in wait");
-    }
-
-    if (WEXITSTATUS(status) != 0) {
-      compilationError("process for '" + args[0] + "' exited with status " +
-                       std::to_string(WEXITSTATUS(status)));
-    }
-  }
-}
-
-void addEnvVarPathsToLinkerArgs(std::vector<std::string> &args,
-                                const std::string &var) {
-  if (const char *path = getenv(var.c_str())) {
-    llvm::StringRef pathStr(path);
-    llvm::SmallVector<llvm::StringRef, 16> split;
-    pathStr.split(split, ":");
-
-    for (const auto &subPath : split) {
-      args.push_back(("-L" + subPath).str());
-    }
-  }
-}
-} // namespace
-
 void LLVMVisitor::writeToExecutable(const std::string &filename,
                                     const std::vector<std::string> &libs) {
-  const std::string objFile = filename + ".o";
-  writeToObjectFile(objFile);
+  std::vector<std::string> objFiles;
+  if (!cacheDir.empty() && !optimized && !db.debug) {
+    objFiles = writeToThinLTOObjectFiles(filename);
+  } else if (jobs != 1) {
+    objFiles = writeToPartitionedObjectFiles(filename);
+  } else {
+    objFiles.push_back(filename + ".o");
+    writeToObjectFile(objFiles.back());
+  }
 
   std::vector<std::string> command = {"clang"};
   addEnvVarPathsToLinkerArgs(command, "LIBRARY_PATH");
@@ -485,14 +950,23 @@ void LLVMVisitor::writeToExecutable(const std::string &filename,
   for (const auto &lib : libs) {
     command.push_back("-l" + lib);
   }
+  if (!profileGenerate.empty()) {
+    // links the profile runtime, which writes the profile on exit
+    command.push_back("-fprofile-generate");
+  }
   std::vector<std::string> extraArgs = {"-lseqrt", "-lomp", "-lpthread", "-ldl",
                                         "-lz",     "-lm",   "-lc",       "-o",
-                                        filename,  objFile};
+                                        filename};
   for (const auto &arg : extraArgs) {
     command.push_back(arg);
   }
+  command.insert(command.end(), objFiles.begin(), objFiles.end());
 
-  executeCommand(command);
+  // partition objects are removed even if linking fails, as they are of no use
+  // afterwards; a single object is kept alongside the executable as before
+  auto status = runCommand(command);
+  removePartitionObjectFiles(objFiles);
+  checkCommandStatus(command, status);
 
 #if __APPLE__
   if (db.debug) {
@@ -529,6 +1003,8 @@ void LLVMVisitor::run(const std::vector<std::string> &args,
   llvm::Function *main = module->getFunction("main");
   llvm::EngineBuilder EB(std::move(module));
   EB.setMCJITMemoryManager(std::make_unique<BoehmGCMemoryManager>());
+  EB.setMCPU(cpu);
+  EB.setMAttrs(llvm::SubtargetFeatures(features).getFeatures());
   llvm::ExecutionEngine *eng = EB.create();
 
   std::string err;
@@ -542,6 +1018,85 @@ void LLVMVisitor::run(const std::vector<std::string> &args,
   delete eng;
 }
 
+void LLVMVisitor::runLazy(const std::vector<std::string> &args,
+                          const std::vector<std::string> &libs) {
+  using namespace std::chrono;
+  auto t = high_resolution_clock::now();
+  verify();
+  const bool debug = db.debug;
+  const bool reoptimize = !optimized;
+  const std::string cpu = this->cpu, features = this->features;
+
+  // The JIT compiles on background threads, so the module has to be moved to a
+  // context of its own.
+  llvm::SmallString<0> bitcode;
+  {
+    llvm::raw_svector_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(*module, os);
+  }
+  auto jitContext = std::make_unique<llvm::LLVMContext>();
+  auto jitModule = orcCheck(llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(bitcode.str(), module->getModuleIdentifier()), *jitContext));
+  llvm::orc::ThreadSafeModule tsm(std::move(jitModule), std::move(jitContext));
+
+  auto jtmb = orcCheck(llvm::orc::JITTargetMachineBuilder::detectHost());
+  jtmb.setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive);
+  if (!cpu.empty()) {
+    jtmb.setCPU(cpu);
+    jtmb.getFeatures() = llvm::SubtargetFeatures(features);
+  }
+  const unsigned n =
+      jobs ? jobs : llvm::heavyweight_hardware_concurrency().compute_thread_count();
+  auto jit =
+      orcCheck(llvm::orc::LLLazyJITBuilder()
+                   .setJITTargetMachineBuilder(std::move(jtmb))
+                   .setNumCompileThreads(n)
+                   .setObjectLinkingLayerCreator(
+                       [](llvm::orc::ExecutionSession &es, const llvm::Triple &)
+                           -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>> {
+                         // one memory manager per object; each registers its data
+                         // sections as GC roots, as with MCJIT
+                         return std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+                             es, []() { return std::make_unique<BoehmGCMemoryManager>(); });
+                       })
+                   .create());
+
+  // Functions are split off into their own modules as they are first called, and
+  // optimized individually right before code generation.
+  jit->getIRTransformLayer().setTransform(
+      [debug, reoptimize, cpu, features](llvm::orc::ThreadSafeModule tsm,
+                                         const llvm::orc::MaterializationResponsibility &)
+          -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+        if (reoptimize)
+          tsm.withModuleDo(
+              [&](llvm::Module &m) { optimizeModule(&m, debug, cpu, features); });
+        return std::move(tsm);
+      });
+
+  auto &dylib = jit->getMainJITDylib();
+  std::string err;
+  for (auto &lib : libs) {
+    if (llvm::sys::DynamicLibrary::LoadLibraryPermanently(lib.c_str(), &err)) {
+      compilationError(err);
+    }
+  }
+  dylib.addGenerator(
+      orcCheck(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          jit->getDataLayout().getGlobalPrefix())));
+  orcCheck(jit->addLazyIRModule(std::move(tsm)));
+  orcCheck(jit->initialize(dylib));
+
+  auto main = orcCheck(jit->lookup("main"));
+  LOG_TIME("[T] llvm/jit-setup = {:.1f}",
+           duration_cast<milliseconds>(high_resolution_clock::now() - t).count() /
+               1000.0);
+  llvm::orc::runAsMain(
+      llvm::jitTargetAddressToFunction<int (*)(int, char *[])>(main.getAddress()),
+      llvm::makeArrayRef(args).drop_front(),
+      args.empty() ? llvm::None : llvm::Optional<llvm::StringRef>(args[0]));
+  orcCheck(jit->deinitialize(dylib));
+}
+
 llvm::FunctionCallee LLVMVisitor::makeAllocFunc(bool atomic) {
   auto f = module->getOrInsertFunction(atomic ? "seq_alloc_atomic" : "seq_alloc",
                                        builder.getInt8PtrTy(), builder.getInt64Ty());
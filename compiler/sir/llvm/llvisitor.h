@@ -129,6 +129,22 @@ private:
   DebugInfo db;
   /// LLVM target machine
   std::unique_ptr<llvm::TargetMachine> machine;
+  /// Whether the LLVM optimization pipeline has already been run
+  bool optimized;
+  /// Number of threads used for optimization and code generation
+  unsigned jobs;
+  /// Target CPU name
+  std::string cpu;
+  /// Target CPU features
+  std::string features;
+  /// Whether to multiversion functions containing loops
+  bool multiversion;
+  /// Profile file that instrumented code writes to, if instrumenting
+  std::string profileGenerate;
+  /// Profile file to optimize with, if any
+  std::string profileUse;
+  /// Directory caching separately compiled modules, if building incrementally
+  std::string cacheDir;
 
   llvm::DIType *
   getDITypeHelper(types::Type *t,
@@ -171,9 +187,11 @@ private:
   TryCatchData *getInnermostTryCatchBeforeLoop();
 
   // LLVM passes
-  void applyDebugTransformations();
-  void runLLVMOptimizationPasses();
+  void runLLVMOptimizationPasses(bool firstRound = true);
+  void multiversionFunctions();
   void runLLVMPipeline();
+  std::vector<std::string> writeToPartitionedObjectFiles(const std::string &filename);
+  std::vector<std::string> writeToThinLTOObjectFiles(const std::string &filename);
 
 public:
   LLVMVisitor(bool debug = false, const std::string &flags = "");
@@ -194,6 +212,35 @@ public:
   void setFunc(llvm::Function *f) { func = f; }
   void setBlock(llvm::BasicBlock *b) { block = b; }
   void setValue(llvm::Value *v) { value = v; }
+  /// Sets the number of threads used to optimize and generate code when
+  /// writing object files and executables, or when running lazily. With more
+  /// than one thread, object files are built from that many partitions of the
+  /// module that are compiled in parallel.
+  /// @param n number of threads, or 0 to use all available cores
+  void setJobs(unsigned n) { jobs = n; }
+  /// Enables or disables multiversioning: functions with loops are cloned for
+  /// SSE4.2, AVX2 and AVX-512 and the clone to run is picked at runtime.
+  /// Only affects release builds for x86-64.
+  /// @param enable whether to multiversion
+  void setMultiversion(bool enable) { multiversion = enable; }
+  /// Instruments the generated code to write an execution profile, which can
+  /// be merged with llvm-profdata and passed to setProfileUse().
+  /// @param filename the profile file written by the instrumented program
+  ///                 (may contain LLVM's %p, %h and %m patterns)
+  void setProfileGenerate(const std::string &filename) { profileGenerate = filename; }
+  /// Optimizes using an execution profile.
+  /// @param filename the indexed profile file
+  void setProfileUse(const std::string &filename) { profileUse = filename; }
+  /// Enables incremental release builds of object files and executables: the
+  /// functions of each source file are optimized separately and cached, and
+  /// ThinLTO imports functions across them before code generation, so only
+  /// source files whose code (including realized generics) changed are
+  /// recompiled.
+  /// @param dir the cache directory, or empty to disable
+  void setCacheDir(const std::string &dir) { cacheDir = dir; }
+  /// @return target CPU name and features
+  std::string getTargetCPU() const { return cpu; }
+  std::string getTargetFeatures() const { return features; }
 
   /// Sets current debug info based on a given node.
   /// @param node the node whose debug info to use
@@ -210,6 +257,11 @@ public:
   /// Dumps the unoptimized module IR to a file.
   /// @param filename name of file to write IR to
   void dump(const std::string &filename = "_dump.ll");
+  /// Replaces the module with one read from an already-optimized
+  /// LLVM bitcode file, such as one written by writeToBitcodeFile().
+  /// @param filename the .bc file to read from
+  /// @return true if the file was read successfully
+  bool readBitcodeFile(const std::string &filename);
   /// Writes module as native object file.
   /// @param filename the .o file to write to
   void writeToObjectFile(const std::string &filename);
@@ -239,6 +291,13 @@ public:
   void run(const std::vector<std::string> &args = {},
            const std::vector<std::string> &libs = {},
            const char *const *envp = nullptr);
+  /// Executes the module with a lazy JIT, which compiles and optimizes
+  /// each function on background threads when it is first called.
+  /// Starts up faster than run(), at the cost of cross-function optimizations.
+  /// @param args vector of arguments to program
+  /// @param libs vector of libraries to load
+  void runLazy(const std::vector<std::string> &args = {},
+               const std::vector<std::string> &libs = {});
 
   /// Get LLVM type from IR type
   /// @param t the IR type
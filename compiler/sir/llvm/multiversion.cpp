@@ -0,0 +1,145 @@
+#include "multiversion.h"
+
+#include <vector>
+
+namespace seq {
+namespace ir {
+namespace {
+// must be consistent with SIMD_* in runtime/sw/intersw.cpp
+const int SIMD_SSE4_2 = 0x20;
+const int SIMD_AVX2 = 0x80;
+const int SIMD_AVX512F = 0x100;
+
+/// Largest function (in instructions) that will be multiversioned
+const unsigned MAX_INSTRUCTIONS = 2000;
+
+struct Version {
+  /// Suffix of the clone's name
+  const char *suffix;
+  /// seq_cpu_simd() flag required to call the clone
+  int flag;
+  /// Target features enabled for the clone
+  const char *features;
+};
+
+/// Versions in order of preference
+const Version VERSIONS[] = {
+    {"avx512", SIMD_AVX512F, "+avx512f,+avx2,+avx,+sse4.2,+sse4.1,+ssse3,+sse3"},
+    {"avx2", SIMD_AVX2, "+avx2,+avx,+sse4.2,+sse4.1,+ssse3,+sse3"},
+    {"sse42", SIMD_SSE4_2, "+sse4.2,+sse4.1,+ssse3,+sse3"},
+};
+
+bool hasLoops(llvm::Function &f) {
+  llvm::DominatorTree dt(f);
+  llvm::LoopInfo li(dt);
+  return !li.empty();
+}
+
+bool shouldMultiversion(llvm::Function &f) {
+  return !f.isDeclaration() && !f.isVarArg() &&
+         !f.hasFnAttribute(llvm::Attribute::AttrKind::AlwaysInline) &&
+         !f.hasFnAttribute(llvm::Attribute::AttrKind::OptimizeNone) &&
+         !f.hasFnAttribute("coroutine.presplit") &&
+         f.getInstructionCount() <= MAX_INSTRUCTIONS && hasLoops(f);
+}
+
+llvm::Function *makeClone(llvm::Function *f, const std::string &suffix,
+                          const std::string &features) {
+  llvm::ValueToValueMapTy vmap;
+  auto *clone = llvm::CloneFunction(f, vmap);
+  clone->setName(f->getName() + "." + suffix);
+  clone->setLinkage(llvm::GlobalValue::PrivateLinkage);
+  clone->setComdat(nullptr);
+  clone->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  if (!features.empty()) {
+    auto old = f->getFnAttribute("target-features").getValueAsString();
+    clone->addFnAttr("target-features",
+                     old.empty() ? features : old.str() + "," + features);
+  }
+  return clone;
+}
+
+void makeForwardingCall(llvm::IRBuilder<> &builder, llvm::Function *f,
+                        llvm::Function *target) {
+  std::vector<llvm::Value *> args;
+  for (auto &arg : f->args()) {
+    args.push_back(&arg);
+  }
+
+  auto attrs = f->getAttributes();
+  std::vector<llvm::AttributeSet> argAttrs;
+  for (unsigned i = 0; i < f->arg_size(); i++) {
+    argAttrs.push_back(attrs.getParamAttributes(i));
+  }
+
+  auto *call = builder.CreateCall(target, args);
+  call->setCallingConv(target->getCallingConv());
+  call->setAttributes(llvm::AttributeList::get(f->getContext(), llvm::AttributeSet(),
+                                               attrs.getRetAttributes(), argAttrs));
+  call->setTailCall();
+  if (f->getReturnType()->isVoidTy()) {
+    builder.CreateRetVoid();
+  } else {
+    builder.CreateRet(call);
+  }
+}
+} // namespace
+
+unsigned multiversionLoops(llvm::Module *module) {
+  llvm::Triple triple(module->getTargetTriple());
+  if (triple.getArch() != llvm::Triple::x86_64)
+    return 0;
+
+  std::vector<llvm::Function *> candidates;
+  for (auto &f : *module) {
+    if (shouldMultiversion(f))
+      candidates.push_back(&f);
+  }
+  if (candidates.empty())
+    return 0;
+
+  auto &context = module->getContext();
+  llvm::IRBuilder<> builder(context);
+  auto simdFunc = module->getOrInsertFunction("seq_cpu_simd", builder.getInt32Ty());
+  auto *g = llvm::cast<llvm::Function>(simdFunc.getCallee());
+  // result is computed once by the runtime and never changes, but is read from
+  // memory that the program cannot see
+  g->setDoesNotThrow();
+  g->setOnlyAccessesInaccessibleMemory();
+  g->setOnlyReadsMemory();
+
+  for (auto *f : candidates) {
+    std::vector<llvm::Function *> clones;
+    for (const auto &version : VERSIONS) {
+      clones.push_back(makeClone(f, version.suffix, version.features));
+    }
+    auto *fallback = makeClone(f, "generic", "");
+
+    // turn the original function into the dispatcher
+    auto linkage = f->getLinkage();
+    f->deleteBody();
+    f->setLinkage(linkage);
+
+    auto *block = llvm::BasicBlock::Create(context, "entry", f);
+    builder.SetInsertPoint(block);
+    llvm::Value *flags = builder.CreateCall(simdFunc);
+    for (unsigned i = 0; i < clones.size(); i++) {
+      auto *versionBlock = llvm::BasicBlock::Create(context, VERSIONS[i].suffix, f);
+      auto *nextBlock = llvm::BasicBlock::Create(context, "next", f);
+      builder.SetInsertPoint(block);
+      llvm::Value *supported = builder.CreateICmpNE(
+          builder.CreateAnd(flags, builder.getInt32(VERSIONS[i].flag)),
+          builder.getInt32(0));
+      builder.CreateCondBr(supported, versionBlock, nextBlock);
+      builder.SetInsertPoint(versionBlock);
+      makeForwardingCall(builder, f, clones[i]);
+      block = nextBlock;
+    }
+    builder.SetInsertPoint(block);
+    makeForwardingCall(builder, f, fallback);
+  }
+  return candidates.size();
+}
+
+} // namespace ir
+} // namespace seq
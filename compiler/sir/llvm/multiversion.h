@@ -0,0 +1,19 @@
+#pragma once
+
+#include "llvm.h"
+
+namespace seq {
+namespace ir {
+
+/// Replaces each function that contains loops with a dispatcher that calls one
+/// of several clones of the function, each targeting a different x86 SIMD
+/// extension (SSE4.2, AVX2 and AVX-512), or a clone of the original function
+/// if none of them is available. The choice is made at runtime based on the
+/// capabilities reported by the runtime's seq_cpu_simd(). Clones are meant to
+/// be vectorized by a later optimization round.
+/// @param module the module to transform
+/// @return the number of functions that were multiversioned
+unsigned multiversionLoops(llvm::Module *module);
+
+} // namespace ir
+} // namespace seq
@@ -2,8 +2,13 @@
 
 #include <algorithm>
 #include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 #include "parser/cache.h"
+#include "sir/util/concurrency.h"
+#include "sir/util/irtools.h"
 
 #include "func.h"
 
@@ -112,7 +117,7 @@ Module::Module(std::string name, std::shared_ptr<ast::Cache> cache)
 Func *Module::getOrRealizeMethod(types::Type *parent, const std::string &methodName,
                                  std::vector<types::Type *> args,
                                  std::vector<types::Generic> generics) {
-
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto cls =
       std::const_pointer_cast<ast::types::Type>(parent->getAstType())->getClass();
   auto method = cache->findMethod(cls.get(), methodName, generateDummyNames(args));
@@ -131,6 +136,7 @@ Func *Module::getOrRealizeFunc(const std::string &funcName,
                                std::vector<types::Type *> args,
                                std::vector<types::Generic> generics,
                                const std::string &module) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto fqName =
       module.empty() ? funcName : fmt::format(FMT_STRING("{}.{}"), module, funcName);
   auto func = cache->findFunction(fqName);
@@ -149,6 +155,7 @@ Func *Module::getOrRealizeFunc(const std::string &funcName,
 types::Type *Module::getOrRealizeType(const std::string &typeName,
                                       std::vector<types::Generic> generics,
                                       const std::string &module) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto fqName =
       module.empty() ? typeName : fmt::format(FMT_STRING("{}.{}"), module, typeName);
   auto type = cache->findClass(fqName);
@@ -163,36 +170,42 @@ types::Type *Module::getOrRealizeType(const std::string &typeName,
 }
 
 types::Type *Module::getVoidType() {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   if (auto *rVal = getType(VOID_NAME))
     return rVal;
   return Nr<types::VoidType>();
 }
 
 types::Type *Module::getBoolType() {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   if (auto *rVal = getType(BOOL_NAME))
     return rVal;
   return Nr<types::BoolType>();
 }
 
 types::Type *Module::getByteType() {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   if (auto *rVal = getType(BYTE_NAME))
     return rVal;
   return Nr<types::ByteType>();
 }
 
 types::Type *Module::getIntType() {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   if (auto *rVal = getType(INT_NAME))
     return rVal;
   return Nr<types::IntType>();
 }
 
 types::Type *Module::getFloatType() {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   if (auto *rVal = getType(FLOAT_NAME))
     return rVal;
   return Nr<types::FloatType>();
 }
 
 types::Type *Module::getStringType() {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   if (auto *rVal = getType(STRING_NAME))
     return rVal;
   return Nr<types::RecordType>(
@@ -202,23 +215,28 @@ types::Type *Module::getStringType() {
 }
 
 types::Type *Module::getPointerType(types::Type *base) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   return getOrRealizeType("Ptr", {base});
 }
 
 types::Type *Module::getArrayType(types::Type *base) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   return getOrRealizeType("Array", {base});
 }
 
 types::Type *Module::getGeneratorType(types::Type *base) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   return getOrRealizeType("Generator", {base});
 }
 
 types::Type *Module::getOptionalType(types::Type *base) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   return getOrRealizeType("Optional", {base});
 }
 
 types::Type *Module::getFuncType(types::Type *rType,
                                  std::vector<types::Type *> argTypes, bool variadic) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto args = translateArgs(argTypes);
   args[0] = std::make_shared<seq::ast::types::LinkType>(rType->getAstType());
   auto *result = cache->makeFunction(args);
@@ -235,10 +253,12 @@ types::Type *Module::getFuncType(types::Type *rType,
 }
 
 types::Type *Module::getIntNType(unsigned int len, bool sign) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   return getOrRealizeType(sign ? "Int" : "UInt", {len});
 }
 
 types::Type *Module::getTupleType(std::vector<types::Type *> args) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   std::vector<ast::types::TypePtr> argTypes;
   for (auto *t : args) {
     seqassert(t->getAstType(), "{} must have an ast type", *t);
@@ -258,10 +278,12 @@ Value *Module::getString(std::string v) {
 }
 
 types::Type *Module::unsafeGetDummyFuncType() {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   return unsafeGetFuncType("<internal_func_type>", getVoidType(), {});
 }
 
 types::Type *Module::unsafeGetPointerType(types::Type *base) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto name = types::PointerType::getInstanceName(base);
   if (auto *rVal = getType(name))
     return rVal;
@@ -269,6 +291,7 @@ types::Type *Module::unsafeGetPointerType(types::Type *base) {
 }
 
 types::Type *Module::unsafeGetArrayType(types::Type *base) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto name = fmt::format(FMT_STRING(".Array[{}]"), base->referenceString());
   if (auto *rVal = getType(name))
     return rVal;
@@ -278,6 +301,7 @@ types::Type *Module::unsafeGetArrayType(types::Type *base) {
 }
 
 types::Type *Module::unsafeGetGeneratorType(types::Type *base) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto name = types::GeneratorType::getInstanceName(base);
   if (auto *rVal = getType(name))
     return rVal;
@@ -285,6 +309,7 @@ types::Type *Module::unsafeGetGeneratorType(types::Type *base) {
 }
 
 types::Type *Module::unsafeGetOptionalType(types::Type *base) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto name = types::OptionalType::getInstanceName(base);
   if (auto *rVal = getType(name))
     return rVal;
@@ -294,12 +319,14 @@ types::Type *Module::unsafeGetOptionalType(types::Type *base) {
 types::Type *Module::unsafeGetFuncType(const std::string &name, types::Type *rType,
                                        std::vector<types::Type *> argTypes,
                                        bool variadic) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   if (auto *rVal = getType(name))
     return rVal;
   return Nr<types::FuncType>(name, rType, std::move(argTypes), variadic);
 }
 
 types::Type *Module::unsafeGetMemberedType(const std::string &name, bool ref) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto *rVal = getType(name);
 
   if (!rVal) {
@@ -318,7 +345,39 @@ types::Type *Module::unsafeGetMemberedType(const std::string &name, bool ref) {
   return rVal;
 }
 
+void Module::markModified(const BodiedFunc *f) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  modifiedFuncs.insert(f->getId());
+}
+
+void Module::findModifiedFuncs(unsigned threads) {
+  auto funcs = util::getBodiedFuncs(static_cast<const Module *>(this));
+  std::vector<std::vector<id_t>> signatures(funcs.size());
+  util::parallelFor(funcs.size(), threads, [&](unsigned, std::size_t i) {
+    signatures[i] = util::structuralSignature(funcs[i]);
+  });
+
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  std::unordered_map<id_t, std::vector<id_t>> newSignatures;
+  for (std::size_t i = 0; i < funcs.size(); i++) {
+    auto id = funcs[i]->getId();
+    auto it = funcSignatures.find(id);
+    if (it == funcSignatures.end() || it->second != signatures[i])
+      modifiedFuncs.insert(id);
+    newSignatures.emplace(id, std::move(signatures[i]));
+  }
+  funcSignatures = std::move(newSignatures);
+}
+
+std::unordered_set<id_t> Module::takeModifiedFuncs() {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  std::unordered_set<id_t> result;
+  std::swap(result, modifiedFuncs);
+  return result;
+}
+
 types::Type *Module::unsafeGetIntNType(unsigned int len, bool sign) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   auto name = types::IntNType::getInstanceName(len, sign);
   if (auto *rVal = getType(name))
     return rVal;
@@ -2,8 +2,11 @@
 
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "util/fmt/format.h"
 #include "util/fmt/ostream.h"
@@ -94,6 +97,14 @@ private:
 
   /// the type-checker cache
   std::shared_ptr<ast::Cache> cache;
+  /// ids of the functions modified since the last call to takeModifiedFuncs()
+  std::unordered_set<id_t> modifiedFuncs;
+  /// structural signatures of the bodied functions as of the last call to
+  /// findModifiedFuncs()
+  std::unordered_map<id_t, std::vector<id_t>> funcSignatures;
+  /// guards node registration, type lookups and realizations, so that passes can
+  /// transform different functions concurrently
+  mutable std::recursive_mutex mutex;
 
 public:
   static const char NodeId;
@@ -135,6 +146,7 @@ public:
   /// @param id the id
   /// @return the variable or nullptr
   Var *getVar(id_t id) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = varMap.find(id);
     return it != varMap.end() ? it->second->get() : nullptr;
   }
@@ -142,12 +154,14 @@ public:
   /// @param id the id
   /// @return the variable or nullptr
   const Var *getVar(id_t id) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = varMap.find(id);
     return it != varMap.end() ? it->second->get() : nullptr;
   }
   /// Removes a given var.
   /// @param v the var
   void remove(const Var *v) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = varMap.find(v->getId());
     vars.erase(it->second);
     varMap.erase(it);
@@ -173,6 +187,7 @@ public:
   /// @param id the id
   /// @return the value or nullptr
   Value *getValue(id_t id) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = valueMap.find(id);
     return it != valueMap.end() ? it->second->get() : nullptr;
   }
@@ -180,12 +195,14 @@ public:
   /// @param id the id
   /// @return the value or nullptr
   const Value *getValue(id_t id) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = valueMap.find(id);
     return it != valueMap.end() ? it->second->get() : nullptr;
   }
   /// Removes a given value.
   /// @param v the value
   void remove(const Value *v) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = valueMap.find(v->getId());
     values.erase(it->second);
     valueMap.erase(it);
@@ -206,18 +223,21 @@ public:
   /// @param name the type's name
   /// @return the type with the given name
   types::Type *getType(const std::string &name) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = typesMap.find(name);
     return it == typesMap.end() ? nullptr : it->second->get();
   }
   /// @param name the type's name
   /// @return the type with the given name
   types::Type *getType(const std::string &name) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = typesMap.find(name);
     return it == typesMap.end() ? nullptr : it->second->get();
   }
   /// Removes a given type.
   /// @param t the type
   void remove(types::Type *t) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     auto it = typesMap.find(t->getName());
     types.erase(it->second);
     typesMap.erase(it);
@@ -259,6 +279,19 @@ public:
     return N<DesiredType>(seq::SrcInfo(), std::forward<Args>(args)...);
   }
 
+  /// Marks a function as modified, so that incremental analyses recompute their
+  /// results for it. Changes to the values and variables of a function are found
+  /// by findModifiedFuncs(), so passes only need to mark other changes.
+  /// @param f the function
+  void markModified(const BodiedFunc *f);
+  /// Marks every bodied function whose structure changed since the last call as
+  /// modified. Functions are compared by util::structuralSignature().
+  /// @param threads the number of threads to hash functions with, or 0 for one per
+  /// core
+  void findModifiedFuncs(unsigned threads = 1);
+  /// @return ids of the functions marked as modified since the last call
+  std::unordered_set<id_t> takeModifiedFuncs();
+
   /// @return the type-checker cache
   std::shared_ptr<ast::Cache> getCache() { return cache; }
   /// @return the type-checker cache
@@ -401,14 +434,17 @@ public:
 
 private:
   void store(types::Type *t) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     types.emplace_back(t);
     typesMap[t->getName()] = std::prev(types.end());
   }
   void store(Value *v) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     values.emplace_back(v);
     valueMap[v->getId()] = std::prev(values.end());
   }
   void store(Var *v) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     vars.emplace_back(v);
     varMap[v->getId()] = std::prev(vars.end());
   }
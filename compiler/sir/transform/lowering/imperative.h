@@ -11,6 +11,9 @@ class ImperativeForFlowLowering : public OperatorPass {
 public:
   static const std::string KEY;
   std::string getKey() const override { return KEY; }
+  std::unique_ptr<Pass> clone() const override {
+    return std::make_unique<ImperativeForFlowLowering>();
+  }
   void handle(ForFlow *v) override;
 };
 
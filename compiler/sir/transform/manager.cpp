@@ -19,7 +19,9 @@
 #include "sir/transform/pythonic/dict.h"
 #include "sir/transform/pythonic/io.h"
 #include "sir/transform/pythonic/str.h"
+#include "sir/util/concurrency.h"
 #include "util/common.h"
+#include "util/stats.h"
 
 namespace seq {
 namespace ir {
@@ -106,7 +108,13 @@ void PassManager::runPass(Module *module, const std::string &name) {
       runAnalysis(module, dep);
     }
 
-    meta.pass->run(module);
+    {
+      CompileStats::Timer timer("ir-pass", name, it);
+      if (threads != 1 && meta.pass->clone())
+        runOnFuncs(module, meta.pass.get());
+      else
+        meta.pass->run(module);
+    }
 
     for (auto &inv : meta.invalidates)
       invalidate(inv);
@@ -116,15 +124,62 @@ void PassManager::runPass(Module *module, const std::string &name) {
   }
 }
 
+void PassManager::runOnFuncs(Module *module, Pass *pass) {
+  // functions realized while the pass runs are processed in another round
+  std::unordered_set<id_t> done;
+  while (true) {
+    std::vector<BodiedFunc *> funcs;
+    for (auto *f : util::getBodiedFuncs(module)) {
+      if (done.insert(f->getId()).second)
+        funcs.push_back(f);
+    }
+    if (funcs.empty())
+      break;
+
+    std::vector<std::unique_ptr<Pass>> workers;
+    for (unsigned i = 0; i < util::numWorkers(threads, funcs.size()); i++) {
+      workers.push_back(pass->clone());
+      workers.back()->setManager(this);
+    }
+    util::parallelFor(funcs.size(), threads, [&](unsigned worker, std::size_t i) {
+      workers[worker]->runOnFunc(funcs[i]);
+    });
+  }
+}
+
 void PassManager::runAnalysis(Module *module, const std::string &name) {
   if (results.find(name) != results.end())
     return;
 
+  collectModifiedFuncs(module);
+  computeAnalysis(module, name);
+}
+
+void PassManager::computeAnalysis(Module *module, const std::string &name) {
+  if (results.find(name) != results.end())
+    return;
+
   auto &meta = analyses[name];
   for (auto &dep : meta.reqs) {
-    runAnalysis(module, dep);
+    computeAnalysis(module, dep);
   }
-  results[name] = meta.analysis->run(module);
+  CompileStats::Timer timer("ir-analysis", name);
+  auto it = staleResults.find(name);
+  if (it != staleResults.end()) {
+    results[name] =
+        meta.analysis->update(module, std::move(it->second), modifiedFuncs[name]);
+    staleResults.erase(it);
+  } else {
+    results[name] = meta.analysis->run(module);
+  }
+  modifiedFuncs[name].clear();
+}
+
+void PassManager::collectModifiedFuncs(Module *module) {
+  module->findModifiedFuncs(threads);
+  auto modified = module->takeModifiedFuncs();
+  for (auto &entry : modifiedFuncs)
+    entry.second.insert(modified.begin(), modified.end());
 }
 
 void PassManager::invalidate(const std::string &key) {
@@ -133,8 +188,10 @@ void PassManager::invalidate(const std::string &key) {
   while (!open.empty()) {
     std::unordered_set<std::string> newOpen;
     for (const auto &k : open) {
-      if (results.find(k) != results.end()) {
-        results.erase(k);
+      auto it = results.find(k);
+      if (it != results.end()) {
+        staleResults[k] = std::move(it->second);
+        results.erase(it);
         newOpen.insert(deps[k].begin(), deps[k].end());
       }
     }
@@ -85,10 +85,17 @@ private:
   std::vector<std::string> executionOrder;
   /// map of valid analysis results
   std::unordered_map<std::string, std::unique_ptr<analyze::Result>> results;
+  /// map of invalidated analysis results, which are updated incrementally
+  std::unordered_map<std::string, std::unique_ptr<analyze::Result>> staleResults;
+  /// ids of the functions modified since each valid or stale result was computed
+  std::unordered_map<std::string, std::unordered_set<id_t>> modifiedFuncs;
 
   /// passes to avoid registering
   std::vector<std::string> disabled;
 
+  /// number of threads for function-level passes and analyses
+  unsigned threads = 1;
+
 public:
   /// PassManager initialization mode.
   enum Init {
@@ -100,8 +107,8 @@ public:
   static const int PASS_IT_MAX;
 
   explicit PassManager(Init init, std::vector<std::string> disabled = {})
-      : km(), passes(), analyses(), executionOrder(), results(),
-        disabled(std::move(disabled)) {
+      : km(), passes(), analyses(), executionOrder(), results(), staleResults(),
+        modifiedFuncs(), disabled(std::move(disabled)) {
     switch (init) {
     case Init::EMPTY:
       break;
@@ -147,6 +154,15 @@ public:
     return it != results.end() ? it->second.get() : nullptr;
   }
 
+  /// Sets the number of threads that function-level passes and analyses use to
+  /// process different functions concurrently. Since new IR nodes are then created
+  /// in a nondeterministic order, node ids are not reproducible with more than one
+  /// thread.
+  /// @param n the number of threads, or 0 for one per core
+  void setThreads(unsigned n) { threads = n; }
+  /// @return the number of threads for function-level passes and analyses
+  unsigned getThreads() const { return threads; }
+
   /// Returns whether a given pass or analysis is disabled.
   /// @param key the (unique'd) pass or analysis key
   /// @return true if the pass or analysis is disabled
@@ -156,8 +172,11 @@ public:
 
 private:
   void runPass(Module *module, const std::string &name);
+  void runOnFuncs(Module *module, Pass *pass);
   void registerStandardPasses(bool debug = false);
   void runAnalysis(Module *module, const std::string &name);
+  void computeAnalysis(Module *module, const std::string &name);
+  void collectModifiedFuncs(Module *module);
   void invalidate(const std::string &key);
 };
 
@@ -32,6 +32,15 @@ public:
   /// @return true if pass should repeat
   virtual bool shouldRepeat() const { return false; }
 
+  /// Creates a new instance of this pass if the pass only transforms the functions
+  /// it is run on, in which case instances are run on different functions
+  /// concurrently via runOnFunc().
+  /// @return the new instance, or nullptr if the pass must run on the whole module
+  virtual std::unique_ptr<Pass> clone() const { return nullptr; }
+  /// Execute the pass on a single function. Only called if clone() is implemented.
+  /// @param func the function
+  virtual void runOnFunc(BodiedFunc *func) {}
+
   /// Sets the manager.
   /// @param mng the new manager
   virtual void setManager(PassManager *mng) { manager = mng; }
@@ -74,6 +83,11 @@ public:
     reset();
     process(module);
   }
+
+  void runOnFunc(BodiedFunc *func) override {
+    reset();
+    processFunc(func);
+  }
 };
 
 } // namespace transform
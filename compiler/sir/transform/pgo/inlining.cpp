@@ -0,0 +1,106 @@
+#include "inlining.h"
+
+#include <unordered_set>
+
+#include "sir/analyze/module/profile.h"
+#include "sir/util/inlining.h"
+#include "sir/util/irtools.h"
+#include "sir/util/operator.h"
+
+namespace seq {
+namespace ir {
+namespace transform {
+namespace pgo {
+namespace {
+struct SizeCounter : public util::Operator {
+  int size = 0;
+
+  void preHook(Node *node) override { ++size; }
+};
+
+int functionSize(BodiedFunc *f) {
+  SizeCounter sc;
+  sc.process(f->getBody());
+  return sc.size;
+}
+
+struct CalleeCollector : public util::Operator {
+  std::vector<BodiedFunc *> callees;
+
+  void handle(CallInstr *v) override {
+    if (auto *f = cast<BodiedFunc>(util::getFunc(v->getCallee())))
+      callees.push_back(f);
+  }
+};
+
+// whether f can call itself, directly or through other functions
+bool isRecursive(BodiedFunc *f) {
+  std::unordered_set<BodiedFunc *> visited;
+  std::vector<BodiedFunc *> work = {f};
+  while (!work.empty()) {
+    auto *g = work.back();
+    work.pop_back();
+    CalleeCollector cc;
+    cc.process(g->getBody());
+    for (auto *h : cc.callees) {
+      if (h == f)
+        return true;
+      if (visited.insert(h).second)
+        work.push_back(h);
+    }
+  }
+  return false;
+}
+} // namespace
+
+const std::string ProfileGuidedInlining::KEY = "core-pgo-inlining";
+const int ProfileGuidedInlining::MAX_CALLEE_SIZE = 200;
+
+void ProfileGuidedInlining::run(Module *m) {
+  numInlined = 0;
+  sites.clear();
+  recursive.clear();
+  // call sites are inlined only once all have been found, so that calls in
+  // freshly inlined bodies are not inlined again in the same run; inner calls
+  // are found after the calls whose arguments they are, and go first
+  OperatorPass::run(m);
+  for (auto it = sites.rbegin(); it != sites.rend(); ++it)
+    inlineSite(it->first, it->second);
+  sites.clear();
+  LOG_IR("[{}] inlined {} hot calls", KEY, numInlined);
+}
+
+void ProfileGuidedInlining::handle(CallInstr *v) {
+  auto *r = getAnalysisResult<analyze::module::ProfileResult>(profileKey);
+  auto *parent = cast<BodiedFunc>(getParentFunc());
+  auto *callee = cast<BodiedFunc>(util::getFunc(v->getCallee()));
+  if (!parent || !callee || parent == callee || callee->isGenerator() ||
+      !r->isHot(parent) || !r->isHot(callee) ||
+      functionSize(callee) > MAX_CALLEE_SIZE)
+    return;
+
+  // inlining a recursive callee only unrolls it, and would do so on every run
+  auto it = recursive.find(callee->getId());
+  if (it == recursive.end())
+    it = recursive.emplace(callee->getId(), isRecursive(callee)).first;
+  if (it->second)
+    return;
+  sites.emplace_back(v, parent);
+}
+
+void ProfileGuidedInlining::inlineSite(CallInstr *v, BodiedFunc *parent) {
+  // hot callees are worth inlining even if they need a loop for early returns
+  auto res = util::inlineCall(v, /*aggressive=*/true);
+  if (!res)
+    return;
+  LOG_IR("[{}] inlining hot call: {}", KEY, *v);
+  for (auto *var : res.newVars)
+    parent->push_back(var);
+  v->replaceAll(res.result);
+  ++numInlined;
+}
+
+} // namespace pgo
+} // namespace transform
+} // namespace ir
+} // namespace seq
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sir/transform/pass.h"
+
+namespace seq {
+namespace ir {
+namespace transform {
+namespace pgo {
+
+/// Pass that inlines small functions at hot call sites, as determined by
+/// an execution profile. Recursive functions are not inlined, and each run
+/// inlines one level of calls.
+class ProfileGuidedInlining : public OperatorPass {
+private:
+  std::string profileKey;
+  int numInlined;
+  /// hot call sites found in this run, with the functions containing them
+  std::vector<std::pair<CallInstr *, BodiedFunc *>> sites;
+  /// whether each callee seen in this run can reach itself
+  std::unordered_map<id_t, bool> recursive;
+
+  void inlineSite(CallInstr *v, BodiedFunc *parent);
+
+public:
+  static const std::string KEY;
+  /// largest callee (in IR nodes) that will be inlined
+  static const int MAX_CALLEE_SIZE;
+
+  /// Constructs a profile-guided inlining pass.
+  /// @param profileKey the profile analysis' key
+  explicit ProfileGuidedInlining(std::string profileKey)
+      : OperatorPass(), profileKey(std::move(profileKey)), numInlined(0), sites(),
+        recursive() {}
+
+  std::string getKey() const override { return KEY; }
+
+  void run(Module *m) override;
+  void handle(CallInstr *v) override;
+
+  /// @return the number of inlined calls
+  int getNumInlined() const { return numInlined; }
+};
+
+} // namespace pgo
+} // namespace transform
+} // namespace ir
+} // namespace seq
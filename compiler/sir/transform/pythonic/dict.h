@@ -14,6 +14,9 @@ class DictArithmeticOptimization : public OperatorPass {
 public:
   static const std::string KEY;
   std::string getKey() const override { return KEY; }
+  std::unique_ptr<Pass> clone() const override {
+    return std::make_unique<DictArithmeticOptimization>();
+  }
   void handle(CallInstr *v) override;
 };
 
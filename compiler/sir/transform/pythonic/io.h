@@ -12,6 +12,9 @@ class IOCatOptimization : public OperatorPass {
 public:
   static const std::string KEY;
   std::string getKey() const override { return KEY; }
+  std::unique_ptr<Pass> clone() const override {
+    return std::make_unique<IOCatOptimization>();
+  }
   void handle(CallInstr *v) override;
 };
 
@@ -12,6 +12,9 @@ class StrAdditionOptimization : public OperatorPass {
 public:
   static const std::string KEY;
   std::string getKey() const override { return KEY; }
+  std::unique_ptr<Pass> clone() const override {
+    return std::make_unique<StrAdditionOptimization>();
+  }
   void handle(CallInstr *v) override;
 };
 
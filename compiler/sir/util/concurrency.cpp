@@ -0,0 +1,57 @@
+#include "concurrency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace seq {
+namespace ir {
+namespace util {
+
+unsigned numWorkers(unsigned threads, std::size_t items) {
+  if (!threads)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  return std::max<std::size_t>(std::min<std::size_t>(threads, items), 1);
+}
+
+void parallelFor(std::size_t items, unsigned threads,
+                 const std::function<void(unsigned, std::size_t)> &fn) {
+  auto n = numWorkers(threads, items);
+  if (n == 1) {
+    for (std::size_t i = 0; i < items; i++)
+      fn(0, i);
+    return;
+  }
+
+  std::atomic<std::size_t> next(0);
+  auto work = [&](unsigned worker) {
+    for (auto i = next++; i < items; i = next++)
+      fn(worker, i);
+  };
+  std::vector<std::thread> workers;
+  for (unsigned w = 1; w < n; w++)
+    workers.emplace_back(work, w);
+  work(0);
+  for (auto &t : workers)
+    t.join();
+}
+
+std::vector<BodiedFunc *> getBodiedFuncs(Module *module) {
+  std::vector<BodiedFunc *> funcs;
+  if (auto *main = cast<BodiedFunc>(module->getMainFunc()))
+    funcs.push_back(main);
+  for (auto *var : *module) {
+    if (auto *f = cast<BodiedFunc>(var))
+      funcs.push_back(f);
+  }
+  return funcs;
+}
+
+std::vector<const BodiedFunc *> getBodiedFuncs(const Module *module) {
+  auto funcs = getBodiedFuncs(const_cast<Module *>(module));
+  return {funcs.begin(), funcs.end()};
+}
+
+} // namespace util
+} // namespace ir
+} // namespace seq
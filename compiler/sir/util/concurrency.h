@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "sir/sir.h"
+
+namespace seq {
+namespace ir {
+namespace util {
+
+/// @param threads the maximum number of threads, or 0 for one per core
+/// @param items the number of work items
+/// @return the number of workers parallelFor() uses for the given arguments
+unsigned numWorkers(unsigned threads, std::size_t items);
+
+/// Calls a function for each index in [0, items), distributing the calls
+/// over numWorkers(threads, items) threads.
+/// @param items the number of work items
+/// @param threads the maximum number of threads, or 0 for one per core
+/// @param fn the function, called with the worker number and the item index
+void parallelFor(std::size_t items, unsigned threads,
+                 const std::function<void(unsigned, std::size_t)> &fn);
+
+/// @param module the module
+/// @return the main function and all other bodied functions of the module
+std::vector<BodiedFunc *> getBodiedFuncs(Module *module);
+
+/// @param module the module
+/// @return the main function and all other bodied functions of the module
+std::vector<const BodiedFunc *> getBodiedFuncs(const Module *module);
+
+} // namespace util
+} // namespace ir
+} // namespace seq
@@ -5,6 +5,21 @@
 namespace seq {
 namespace ir {
 namespace util {
+namespace {
+// lists are prefixed with their lengths, so that different structures never have
+// the same signature
+void appendValue(std::vector<id_t> &sig, const Value *v) {
+  sig.push_back(v->getId());
+  auto vars = v->getUsedVariables();
+  sig.push_back(vars.size());
+  for (auto *var : vars)
+    sig.push_back(var->getId());
+  auto children = v->getUsedValues();
+  sig.push_back(children.size());
+  for (auto *child : children)
+    appendValue(sig, child);
+}
+} // namespace
 
 bool hasAttribute(const Func *func, const std::string &attribute) {
   if (auto *attr = func->getAttribute<KeyValueAttribute>()) {
@@ -246,6 +261,19 @@ void setReturnType(Func *func, types::Type *rType) {
   func->setType(M->getFuncType(rType, argTypes));
 }
 
+std::vector<id_t> structuralSignature(const BodiedFunc *func) {
+  std::vector<id_t> sig;
+  sig.push_back(std::distance(func->arg_begin(), func->arg_end()));
+  for (auto it = func->arg_begin(); it != func->arg_end(); ++it)
+    sig.push_back((*it)->getId());
+  sig.push_back(std::distance(func->begin(), func->end()));
+  for (auto *var : *func)
+    sig.push_back(var->getId());
+  if (auto *body = func->getBody())
+    appendValue(sig, body);
+  return sig;
+}
+
 } // namespace util
 } // namespace ir
 } // namespace seq
@@ -201,6 +201,13 @@ types::Type *getReturnType(const Func *func);
 /// @param rType the new return type
 void setReturnType(Func *func, types::Type *rType);
 
+/// Lists the structure of a function, i.e. the ids of its arguments, symbols and
+/// (replaced) values, and the nesting of its values. Any transformation that adds,
+/// removes, replaces or moves values or variables changes the signature.
+/// @param func the function
+/// @return the signature
+std::vector<id_t> structuralSignature(const BodiedFunc *func);
+
 } // namespace util
 } // namespace ir
 } // namespace seq
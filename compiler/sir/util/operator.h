@@ -73,6 +73,16 @@ public:
     process(f->getBody());
   }
 
+  /// Processes a single function as it would be processed as part of its module.
+  /// @param f the function
+  void processFunc(BodiedFunc *f) {
+    nodeStack.push_back(f->getModule());
+    nodeStack.push_back(f);
+    process(f);
+    nodeStack.pop_back();
+    nodeStack.pop_back();
+  }
+
   LAMBDA_VISIT(VarValue);
   LAMBDA_VISIT(PointerValue);
 
@@ -0,0 +1,205 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sys/resource.h>
+
+#include "util/common.h"
+
+namespace seq {
+namespace {
+thread_local CompileStats::Timer *currentTimer = nullptr;
+
+bool isDetailCategory(const std::string &category) {
+  return category == "realize" || category == "llvm-function";
+}
+
+std::string escapeJSON(const std::string &s) {
+  std::string result;
+  for (char c : s) {
+    switch (c) {
+    case '"':
+      result += "\\\"";
+      break;
+    case '\\':
+      result += "\\\\";
+      break;
+    case '\n':
+      result += "\\n";
+      break;
+    case '\t':
+      result += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+        result += fmt::format("\\u{:04x}", static_cast<unsigned char>(c));
+      else
+        result += c;
+    }
+  }
+  return result;
+}
+
+void writeEventsJSON(std::ostream &os, const std::vector<CompileStats::Event> &events) {
+  os << "[";
+  for (unsigned i = 0; i < events.size(); i++) {
+    const auto &e = events[i];
+    os << (i ? ",\n    " : "\n    ")
+       << fmt::format("{{\"category\": \"{}\", \"name\": \"{}\", \"iteration\": {}, "
+                      "\"start\": {:.6f}, \"time\": {:.6f}, \"self_time\": {:.6f}, "
+                      "\"memory\": {}}}",
+                      escapeJSON(e.category), escapeJSON(e.name), e.iteration, e.start,
+                      e.total, e.self, e.memory);
+  }
+  os << (events.empty() ? "]" : "\n  ]");
+}
+
+/// @return events of the given kind, slowest (by self time) first
+std::vector<CompileStats::Event> slowest(const std::vector<CompileStats::Event> &events,
+                                         const std::string &category) {
+  std::vector<CompileStats::Event> result;
+  std::copy_if(events.begin(), events.end(), std::back_inserter(result),
+               [&](const CompileStats::Event &e) { return e.category == category; });
+  std::stable_sort(result.begin(), result.end(),
+                   [](const CompileStats::Event &a, const CompileStats::Event &b) {
+                     return a.self > b.self;
+                   });
+  return result;
+}
+} // namespace
+
+CompileStats::Timer::Timer(const char *category, std::string_view name, int iteration)
+    : stats(&CompileStats::instance()), event(), start(), startMemory(0), nested(0),
+      parent(nullptr) {
+  if (!stats->isEnabled()) {
+    stats = nullptr;
+    return;
+  }
+  event.category = category;
+  event.name = std::string(name);
+  event.iteration = iteration;
+  startMemory = getPeakMemory();
+  parent = currentTimer;
+  currentTimer = this;
+  start = std::chrono::high_resolution_clock::now();
+}
+
+CompileStats::Timer::~Timer() {
+  if (!stats)
+    return;
+  using namespace std::chrono;
+  event.start = duration_cast<duration<double>>(start - stats->epoch).count();
+  event.total =
+      duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+  event.self = event.total - nested;
+  event.memory = getPeakMemory() - startMemory;
+  currentTimer = parent;
+  if (parent)
+    parent->nested += event.total;
+  stats->record(std::move(event));
+}
+
+CompileStats &CompileStats::instance() {
+  static CompileStats stats;
+  return stats;
+}
+
+int64_t CompileStats::getPeakMemory() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return int64_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+void CompileStats::enable(bool print, const std::string &jsonFile) {
+  if (!enabled) {
+    epoch = std::chrono::high_resolution_clock::now();
+    std::atexit(report);
+  }
+  enabled = true;
+  this->print = print;
+  this->jsonFile = jsonFile;
+}
+
+void CompileStats::record(Event event) {
+  std::lock_guard<std::mutex> lock(mutex);
+  events.push_back(std::move(event));
+}
+
+void CompileStats::report() {
+  auto &stats = instance();
+  std::lock_guard<std::mutex> lock(stats.mutex);
+  if (stats.print)
+    stats.printReport(std::cerr);
+  if (!stats.jsonFile.empty()) {
+    std::ofstream os(stats.jsonFile);
+    stats.writeJSON(os);
+    if (!os)
+      compilationWarning("could not write compile statistics to " + stats.jsonFile);
+  }
+}
+
+void CompileStats::printReport(std::ostream &os, size_t top) const {
+  // events are recorded when they end, so list phases by start time instead
+  std::vector<const Event *> phases;
+  for (const auto &e : events) {
+    if (!isDetailCategory(e.category))
+      phases.push_back(&e);
+  }
+  std::stable_sort(phases.begin(), phases.end(),
+                   [](const Event *a, const Event *b) { return a->start < b->start; });
+
+  os << "===-------------------------------------------------------------------===\n"
+     << "                      Seq compilation time report\n"
+     << "===-------------------------------------------------------------------===\n";
+  os << fmt::format("  {:>10}  {:>10}  {:>11}  {}\n", "Wall (s)", "Self (s)",
+                    "Memory (KB)", "Phase");
+  for (const auto *e : phases) {
+    auto name = e->category + " " + e->name;
+    if (e->iteration)
+      name += fmt::format(" (iteration {})", e->iteration + 1);
+    os << fmt::format("  {:>10.4f}  {:>10.4f}  {:>11}  {}\n", e->total, e->self,
+                      e->memory / 1024, name);
+  }
+
+  for (const auto &category : {std::string("realize"), std::string("llvm-function")}) {
+    auto sorted = slowest(events, category);
+    if (sorted.empty())
+      continue;
+    double total = 0;
+    for (const auto &e : sorted)
+      total += e.self;
+    os << fmt::format("\n  Slowest {} of {} {} ({:.4f}s in total):\n",
+                      std::min<size_t>(top, sorted.size()), sorted.size(),
+                      category == "realize" ? "realizations" : "LLVM functions", total);
+    for (size_t i = 0; i < sorted.size() && i < top; i++)
+      os << fmt::format("  {:>10.4f}  {:>10.4f}  {:>11}  {}\n", sorted[i].total,
+                        sorted[i].self, sorted[i].memory / 1024, sorted[i].name);
+  }
+  os << fmt::format("\n  Peak memory: {} KB\n", getPeakMemory() / 1024);
+}
+
+void CompileStats::writeJSON(std::ostream &os) const {
+  std::vector<Event> phases;
+  std::copy_if(events.begin(), events.end(), std::back_inserter(phases),
+               [](const Event &e) { return !isDetailCategory(e.category); });
+  std::stable_sort(phases.begin(), phases.end(),
+                   [](const Event &a, const Event &b) { return a.start < b.start; });
+  os << "{\n  \"version\": \""
+     << fmt::format("{}.{}.{}", SEQ_VERSION_MAJOR, SEQ_VERSION_MINOR, SEQ_VERSION_PATCH)
+     << "\",\n  \"peak_memory\": " << getPeakMemory() << ",\n  \"phases\": ";
+  writeEventsJSON(os, phases);
+  os << ",\n  \"realizations\": ";
+  writeEventsJSON(os, slowest(events, "realize"));
+  os << ",\n  \"functions\": ";
+  writeEventsJSON(os, slowest(events, "llvm-function"));
+  os << "\n}\n";
+}
+
+} // namespace seq
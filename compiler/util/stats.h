@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace seq {
+
+/// Collects the wall time and memory used by compiler phases, IR passes,
+/// realizations and LLVM functions, for -time-passes and -compile-stats.
+class CompileStats {
+public:
+  /// A timed compiler event.
+  struct Event {
+    /// the event category, e.g. "parser" or "ir-pass"
+    std::string category;
+    /// the event name, e.g. a pass key or a realized function name
+    std::string name;
+    /// the iteration of a repeated pass, starting at 0
+    int iteration;
+    /// start time in seconds since statistics were enabled
+    double start;
+    /// wall time in seconds, including nested events
+    double total;
+    /// wall time in seconds, excluding nested events
+    double self;
+    /// growth of the peak resident set size in bytes
+    int64_t memory;
+  };
+
+  /// Times an event from construction to destruction; does nothing
+  /// (not even copy its names) unless statistics are enabled.
+  class Timer {
+  private:
+    CompileStats *stats;
+    Event event;
+    std::chrono::high_resolution_clock::time_point start;
+    int64_t startMemory;
+    /// time spent in nested timers of the same thread
+    double nested;
+    /// the enclosing timer of the same thread
+    Timer *parent;
+
+  public:
+    Timer(const char *category, std::string_view name, int iteration = 0);
+    ~Timer();
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+  };
+
+private:
+  bool enabled;
+  bool print;
+  std::string jsonFile;
+  std::chrono::high_resolution_clock::time_point epoch;
+  std::vector<Event> events;
+  std::mutex mutex;
+
+  CompileStats()
+      : enabled(false), print(false), jsonFile(), epoch(), events(), mutex() {}
+
+  static void report();
+
+public:
+  /// @return the global statistics
+  static CompileStats &instance();
+  /// @return the peak resident set size of the process in bytes
+  static int64_t getPeakMemory();
+
+  /// Enables statistics, which are reported when the process exits.
+  /// @param print whether to print a report to stderr
+  /// @param jsonFile file to write the statistics to as JSON, or empty
+  void enable(bool print, const std::string &jsonFile);
+  /// @return true if statistics are enabled
+  bool isEnabled() const { return enabled; }
+
+  /// Records an event. Thread-safe.
+  void record(Event event);
+  /// @return recorded events
+  const std::vector<Event> &getEvents() const { return events; }
+
+  /// Prints a human-readable report.
+  /// @param os the output stream
+  /// @param top the number of slowest realizations and functions to list
+  void printReport(std::ostream &os, size_t top = 20) const;
+  /// Writes all events as JSON.
+  /// @param os the output stream
+  void writeJSON(std::ostream &os) const;
+};
+
+} // namespace seq
@@ -0,0 +1,80 @@
+#include <array>
+#include <cstdint>
+
+#include "lib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEQ_BAM_X86 1
+#include <tmmintrin.h>
+#endif
+
+/*
+ * BAM field decoding
+ *
+ * Record sequences are stored as 4-bit codes, two to a byte, with the first
+ * base in the high nibble. They are expanded to ASCII sixteen bytes (32 bases)
+ * at a time with a byte shuffle where SSSE3 is available, and two bases per
+ * table lookup otherwise.
+ */
+
+namespace {
+const char SEQ_NT16_STR[] = "=ACMGRSVTWYHKDBN"; // see htslib's hts.c
+
+const std::array<uint16_t, 256> &pairTable() {
+  static const std::array<uint16_t, 256> table = [] {
+    std::array<uint16_t, 256> t{};
+    for (unsigned i = 0; i < 256; i++) {
+      // little-endian: the first base goes in the low byte
+      t[i] = (uint16_t)((uint8_t)SEQ_NT16_STR[i >> 4] |
+                        ((uint8_t)SEQ_NT16_STR[i & 0xf] << 8));
+    }
+    return t;
+  }();
+  return table;
+}
+
+void unpackSeqScalar(const uint8_t *packed, seq_int_t n, char *out) {
+  const auto &table = pairTable();
+  seq_int_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    uint16_t pair = table[packed[i >> 1]];
+    out[i] = (char)(pair & 0xff);
+    out[i + 1] = (char)(pair >> 8);
+  }
+  if (i < n)
+    out[i] = SEQ_NT16_STR[packed[i >> 1] >> 4];
+}
+
+#ifdef SEQ_BAM_X86
+__attribute__((target("ssse3"))) void unpackSeqSSSE3(const uint8_t *packed,
+                                                      seq_int_t n, char *out) {
+  const __m128i lut = _mm_loadu_si128((const __m128i *)SEQ_NT16_STR);
+  const __m128i mask = _mm_set1_epi8(0xf);
+  seq_int_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(packed + (i >> 1)));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    __m128i lo = _mm_and_si128(v, mask);
+    _mm_storeu_si128((__m128i *)(out + i),
+                     _mm_shuffle_epi8(lut, _mm_unpacklo_epi8(hi, lo)));
+    _mm_storeu_si128((__m128i *)(out + i + 16),
+                     _mm_shuffle_epi8(lut, _mm_unpackhi_epi8(hi, lo)));
+  }
+  unpackSeqScalar(packed + (i >> 1), n - i, out + i);
+}
+#endif
+} // namespace
+
+SEQ_FUNC void seq_bam_unpack_seq(const uint8_t *packed, seq_int_t n, char *out) {
+#ifdef SEQ_BAM_X86
+  static const bool ssse3 = __builtin_cpu_supports("ssse3");
+  if (ssse3)
+    return unpackSeqSSSE3(packed, n, out);
+#endif
+  unpackSeqScalar(packed, n, out);
+}
+
+SEQ_FUNC void seq_bam_unpack_qual(const uint8_t *qual, seq_int_t n, char *out) {
+  for (seq_int_t i = 0; i < n; i++)
+    out[i] = (char)(qual[i] + 33);
+}
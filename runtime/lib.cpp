@@ -15,9 +15,15 @@
 #include <unwind.h>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #define GC_THREADS
 #include "lib.h"
+#include "sw/ksw.h"
 #include "sw/ksw2.h"
+#include "sw/myers.h"
 #include <gc.h>
 
 using namespace std;
@@ -202,6 +208,54 @@ SEQ_FUNC void seq_print_full(seq_str_t str, FILE *fo) {
   fwrite(str.str, 1, (size_t)str.len, fo);
 }
 
+// Maps an uncompressed, non-empty regular file read-only for sequential reading.
+// Returns null for anything else, in which case the file should be read normally.
+SEQ_FUNC void *seq_mmap_file(const char *path, seq_int_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  void *p = nullptr;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    auto *bytes = (unsigned char *)p;
+    if (p == MAP_FAILED) {
+      p = nullptr;
+    } else if (st.st_size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+      // gzip magic number
+      munmap(p, (size_t)st.st_size);
+      p = nullptr;
+    } else {
+      madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+      *size = (seq_int_t)st.st_size;
+    }
+  }
+  close(fd);
+  return p;
+}
+
+SEQ_FUNC void *seq_mmap_shared(const char *path, seq_int_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  void *p = nullptr;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    // shared so that processes mapping the same file use the same page cache pages
+    p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      p = nullptr;
+    } else {
+      madvise(p, (size_t)st.st_size, MADV_RANDOM);
+      *size = (seq_int_t)st.st_size;
+    }
+  }
+  close(fd);
+  return p;
+}
+
+SEQ_FUNC void seq_munmap_file(void *p, seq_int_t size) { munmap(p, (size_t)size); }
+
 SEQ_FUNC void *seq_stdin() { return stdin; }
 
 SEQ_FUNC void *seq_stdout() { return stdout; }
@@ -321,32 +375,49 @@ struct Alignment {
   seq_int_t score;
 };
 
+// must be consistent with _ALIGN_KIND_* in bio/align.seq
+enum { ALIGN_KIND_REGULAR = 0, ALIGN_KIND_DUAL = 1, ALIGN_KIND_SPLICE = 2 };
+
+// ksw2 memory pool and encoding buffers of the calling thread, kept across
+// alignments so that these do not allocate once warmed up
+struct AlignScratch {
+  void *km;
+  vector<uint8_t> qbuf;
+  vector<uint8_t> tbuf;
+
+  AlignScratch() : km(km_init()), qbuf(128), tbuf(128) {}
+  ~AlignScratch() { km_destroy(km); }
+};
+
+static AlignScratch &alignScratch() {
+  thread_local AlignScratch scratch;
+  return scratch;
+}
+
+template <typename F>
+static uint8_t *alignEncode(vector<uint8_t> &buf, seq_t s, F enc_func) {
+  const size_t n = abs(s.len);
+  if (buf.size() < n)
+    buf.resize(n);
+  enc_func(s, buf.data());
+  return buf.data();
+}
+
 #define ALIGN_ENCODE(enc_func)                                                         \
-  uint8_t static_qbuf[128];                                                            \
-  uint8_t static_tbuf[128];                                                            \
+  AlignScratch &scratch = alignScratch();                                              \
+  void *km = scratch.km;                                                               \
   const int qlen = abs(query.len);                                                     \
   const int tlen = abs(target.len);                                                    \
-  uint8_t *qbuf = qlen <= sizeof(static_qbuf) ? &static_qbuf[0]                        \
-                                              : (uint8_t *)seq_alloc_atomic(qlen);     \
-  uint8_t *tbuf = tlen <= sizeof(static_tbuf) ? &static_tbuf[0]                        \
-                                              : (uint8_t *)seq_alloc_atomic(tlen);     \
-  (enc_func)(query, qbuf);                                                             \
-  (enc_func)(target, tbuf)
-
-#define ALIGN_RELEASE()                                                                \
-  if (qbuf != &static_qbuf[0])                                                         \
-    seq_free(qbuf);                                                                    \
-  if (tbuf != &static_tbuf[0])                                                         \
-  seq_free(tbuf)
+  uint8_t *qbuf = alignEncode(scratch.qbuf, query, enc_func);                          \
+  uint8_t *tbuf = alignEncode(scratch.tbuf, target, enc_func)
 
 SEQ_FUNC void seq_align(seq_t query, seq_t target, int8_t *mat, int8_t gapo,
                         int8_t gape, seq_int_t bandwidth, seq_int_t zdrop,
                         seq_int_t end_bonus, seq_int_t flags, Alignment *out) {
   ksw_extz_t ez;
   ALIGN_ENCODE(encode);
-  ksw_extz2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, gapo, gape, (int)bandwidth,
+  ksw_extz2_sse(km, qlen, qbuf, tlen, tbuf, 5, mat, gapo, gape, (int)bandwidth,
                 (int)zdrop, end_bonus, (int)flags, &ez);
-  ALIGN_RELEASE();
   *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
 }
 
@@ -357,9 +428,8 @@ SEQ_FUNC void seq_align_default(seq_t query, seq_t target, Alignment *out) {
   int n_cigar = 0;
   uint32_t *cigar = nullptr;
   ALIGN_ENCODE(encode);
-  int score = ksw_gg2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, 0, 1, -1, &m_cigar,
+  int score = ksw_gg2_sse(km, qlen, qbuf, tlen, tbuf, 5, mat, 0, 1, -1, &m_cigar,
                           &n_cigar, &cigar);
-  ALIGN_RELEASE();
   *out = {{cigar, n_cigar}, score};
 }
 
@@ -369,9 +439,8 @@ SEQ_FUNC void seq_align_dual(seq_t query, seq_t target, int8_t *mat, int8_t gapo
                              seq_int_t flags, Alignment *out) {
   ksw_extz_t ez;
   ALIGN_ENCODE(encode);
-  ksw_extd2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2, gape2,
+  ksw_extd2_sse(km, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2, gape2,
                 (int)bandwidth, (int)zdrop, end_bonus, (int)flags, &ez);
-  ALIGN_RELEASE();
   *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
 }
 
@@ -380,12 +449,120 @@ SEQ_FUNC void seq_align_splice(seq_t query, seq_t target, int8_t *mat, int8_t ga
                                seq_int_t zdrop, seq_int_t flags, Alignment *out) {
   ksw_extz_t ez;
   ALIGN_ENCODE(encode);
-  ksw_exts2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2, noncan,
+  ksw_exts2_sse(km, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2, noncan,
                 (int)zdrop, (int)flags, &ez);
-  ALIGN_RELEASE();
   *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
 }
 
+// aligns queries[i] (or queries[0] if nqueries is 1) against targets[i]; each
+// query is encoded only once for a run of pairs that share it
+SEQ_FUNC void seq_align_batch(seq_t *queries, seq_int_t nqueries, seq_t *targets,
+                              seq_int_t n, seq_int_t kind, int8_t *mat, int8_t gapo1,
+                              int8_t gape1, int8_t gapo2, int8_t gape2,
+                              seq_int_t bandwidth, seq_int_t zdrop, seq_int_t end_bonus,
+                              seq_int_t flags, Alignment *out) {
+  AlignScratch &scratch = alignScratch();
+  void *km = scratch.km;
+  seq_t encoded = {0, nullptr};
+  uint8_t *qbuf = nullptr;
+  for (seq_int_t i = 0; i < n; i++) {
+    seq_t query = queries[nqueries == 1 ? 0 : i];
+    seq_t target = targets[i];
+    if (!qbuf || query.seq != encoded.seq || query.len != encoded.len) {
+      qbuf = alignEncode(scratch.qbuf, query, encode);
+      encoded = query;
+    }
+    uint8_t *tbuf = alignEncode(scratch.tbuf, target, encode);
+    const int qlen = abs(query.len);
+    const int tlen = abs(target.len);
+
+    ksw_extz_t ez;
+    switch (kind) {
+    case ALIGN_KIND_DUAL:
+      ksw_extd2_sse(km, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2, gape2,
+                    (int)bandwidth, (int)zdrop, end_bonus, (int)flags, &ez);
+      break;
+    case ALIGN_KIND_SPLICE: // gape2 is the non-canonical splice site penalty
+      ksw_exts2_sse(km, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, gapo2, gape2,
+                    (int)zdrop, (int)flags, &ez);
+      break;
+    default:
+      ksw_extz2_sse(km, qlen, qbuf, tlen, tbuf, 5, mat, gapo1, gape1, (int)bandwidth,
+                    (int)zdrop, end_bonus, (int)flags, &ez);
+    }
+    out[i] = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
+  }
+}
+
+struct LocalAlignment {
+  seq_int_t score;
+  seq_int_t qend;
+  seq_int_t tend;
+};
+
+SEQ_FUNC void *seq_qprofile_init(seq_t query, int8_t *mat, int8_t gapo, int8_t gape) {
+  uint8_t *qbuf = alignEncode(alignScratch().qbuf, query, encode);
+  return ksw_qinit(abs(query.len), qbuf, 5, mat, gapo, gape);
+}
+
+// aligns the profiled query against each of targets[0..n)
+SEQ_FUNC void seq_qprofile_align(void *prof, seq_t *targets, seq_int_t n,
+                                 LocalAlignment *out) {
+  AlignScratch &scratch = alignScratch();
+  for (seq_int_t i = 0; i < n; i++) {
+    uint8_t *tbuf = alignEncode(scratch.tbuf, targets[i], encode);
+    kswr_t r = ksw_qalign((kswq_t *)prof, abs(targets[i].len), tbuf);
+    out[i] = {r.score, r.qe, r.te};
+  }
+}
+
+// reverse complements are encoded into buf; the codes map to themselves in
+// seq_nt4_table, so either way the result can be read through it
+static const uint8_t *forwardBytes(vector<uint8_t> &buf, seq_t s) {
+  return s.len >= 0 ? (const uint8_t *)s.seq : alignEncode(buf, s, encode);
+}
+
+SEQ_FUNC seq_int_t seq_edit_distance(seq_t a, seq_t b, seq_int_t max_dist) {
+  AlignScratch &scratch = alignScratch();
+  return myers_dist(forwardBytes(scratch.qbuf, a), abs(a.len),
+                    forwardBytes(scratch.tbuf, b), abs(b.len), seq_nt4_table,
+                    (int)min(max_dist, (seq_int_t)INT_MAX));
+}
+
+SEQ_FUNC void seq_edit_distance_many(seq_t query, seq_t *targets, seq_int_t n,
+                                     seq_int_t max_dist, seq_int_t *out) {
+  AlignScratch &scratch = alignScratch();
+  thread_local vector<const uint8_t *> ts;
+  thread_local vector<int> ns, dists;
+  ts.resize(n);
+  ns.resize(n);
+  dists.resize(n);
+
+  // reverse complements go one after another into tbuf
+  size_t rc = 0;
+  for (seq_int_t i = 0; i < n; i++)
+    rc += targets[i].len < 0 ? -targets[i].len : 0;
+  if (scratch.tbuf.size() < rc)
+    scratch.tbuf.resize(rc);
+  rc = 0;
+  for (seq_int_t i = 0; i < n; i++) {
+    ns[i] = (int)abs(targets[i].len);
+    if (targets[i].len >= 0) {
+      ts[i] = (const uint8_t *)targets[i].seq;
+    } else {
+      encode(targets[i], &scratch.tbuf[rc]);
+      ts[i] = &scratch.tbuf[rc];
+      rc += ns[i];
+    }
+  }
+
+  myers_dist_many(forwardBytes(scratch.qbuf, query), abs(query.len), ts.data(),
+                  ns.data(), (int)n, seq_nt4_table,
+                  (int)min(max_dist, (seq_int_t)INT_MAX), dists.data());
+  for (seq_int_t i = 0; i < n; i++)
+    out[i] = dists[i];
+}
+
 SEQ_FUNC void seq_align_global(seq_t query, seq_t target, int8_t *mat, int8_t gapo,
                                int8_t gape, seq_int_t bandwidth, bool backtrace,
                                Alignment *out) {
@@ -393,9 +570,8 @@ SEQ_FUNC void seq_align_global(seq_t query, seq_t target, int8_t *mat, int8_t ga
   int n_cigar = 0;
   uint32_t *cigar = nullptr;
   ALIGN_ENCODE(encode);
-  int score = ksw_gg2_sse(nullptr, qlen, qbuf, tlen, tbuf, 5, mat, gapo, gape,
+  int score = ksw_gg2_sse(km, qlen, qbuf, tlen, tbuf, 5, mat, gapo, gape,
                           (int)bandwidth, &m_cigar, &n_cigar, &cigar);
-  ALIGN_RELEASE();
   *out = {{backtrace ? cigar : nullptr, backtrace ? n_cigar : 0}, score};
 }
 
@@ -404,9 +580,8 @@ SEQ_FUNC void seq_palign(seq_t query, seq_t target, int8_t *mat, int8_t gapo,
                          seq_int_t end_bonus, seq_int_t flags, Alignment *out) {
   ksw_extz_t ez;
   ALIGN_ENCODE(pencode);
-  ksw_extz2_sse(nullptr, qlen, qbuf, tlen, tbuf, 23, mat, gapo, gape, (int)bandwidth,
+  ksw_extz2_sse(km, qlen, qbuf, tlen, tbuf, 23, mat, gapo, gape, (int)bandwidth,
                 (int)zdrop, end_bonus, (int)flags, &ez);
-  ALIGN_RELEASE();
   *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
 }
 
@@ -442,9 +617,8 @@ SEQ_FUNC void seq_palign_default(seq_t query, seq_t target, Alignment *out) {
       3,  0,  0,  -1, -2, -3, -1, -2, 4};
   ksw_extz_t ez;
   ALIGN_ENCODE(pencode);
-  ksw_extz2_sse(nullptr, qlen, qbuf, tlen, tbuf, 23, mat, 11, 1, -1, -1,
+  ksw_extz2_sse(km, qlen, qbuf, tlen, tbuf, 23, mat, 11, 1, -1, -1,
                 /* end_bonus */ 0, 0, &ez);
-  ALIGN_RELEASE();
   *out = {{ez.cigar, ez.n_cigar}, ez.score};
 }
 
@@ -454,9 +628,8 @@ SEQ_FUNC void seq_palign_dual(seq_t query, seq_t target, int8_t *mat, int8_t gap
                               seq_int_t flags, Alignment *out) {
   ksw_extz_t ez;
   ALIGN_ENCODE(pencode);
-  ksw_extd2_sse(nullptr, qlen, qbuf, tlen, tbuf, 23, mat, gapo1, gape1, gapo2, gape2,
+  ksw_extd2_sse(km, qlen, qbuf, tlen, tbuf, 23, mat, gapo1, gape1, gapo2, gape2,
                 (int)bandwidth, (int)zdrop, end_bonus, (int)flags, &ez);
-  ALIGN_RELEASE();
   *out = {{ez.cigar, ez.n_cigar}, flags & KSW_EZ_EXTZ_ONLY ? ez.max : ez.score};
 }
 
@@ -466,9 +639,8 @@ SEQ_FUNC void seq_palign_global(seq_t query, seq_t target, int8_t *mat, int8_t g
   int n_cigar = 0;
   uint32_t *cigar = nullptr;
   ALIGN_ENCODE(pencode);
-  int score = ksw_gg2_sse(nullptr, qlen, qbuf, tlen, tbuf, 23, mat, gapo, gape,
+  int score = ksw_gg2_sse(km, qlen, qbuf, tlen, tbuf, 23, mat, gapo, gape,
                           (int)bandwidth, &m_cigar, &n_cigar, &cigar);
-  ALIGN_RELEASE();
   *out = {{cigar, n_cigar}, score};
 }
 
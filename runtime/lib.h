@@ -54,6 +54,23 @@ SEQ_FUNC seq_str_t seq_str_byte(char c);
 SEQ_FUNC seq_str_t seq_str_ptr(void *p);
 SEQ_FUNC seq_str_t seq_str_tuple(seq_str_t *strs, seq_int_t n);
 
+SEQ_FUNC void *seq_mmap_file(const char *path, seq_int_t *size);
+SEQ_FUNC void *seq_mmap_shared(const char *path, seq_int_t *size);
+SEQ_FUNC void seq_munmap_file(void *p, seq_int_t size);
+SEQ_FUNC void *seq_readahead_open(const char *path, seq_int_t threads);
+SEQ_FUNC seq_int_t seq_readahead_read(void *r, char *buf, seq_int_t n);
+SEQ_FUNC bool seq_readahead_seek(void *r, seq_int_t pos);
+SEQ_FUNC void seq_readahead_close(void *r);
+SEQ_FUNC void seq_bam_unpack_seq(const uint8_t *packed, seq_int_t n, char *out);
+SEQ_FUNC void seq_bam_unpack_qual(const uint8_t *qual, seq_int_t n, char *out);
+SEQ_FUNC void *seq_writer_open_file(FILE *fp);
+SEQ_FUNC void *seq_writer_open_bgzf(const char *path, const char *mode);
+SEQ_FUNC bool seq_writer_write(void *w, const char *buf, seq_int_t n);
+SEQ_FUNC bool seq_writer_write_int(void *w, seq_int_t n);
+SEQ_FUNC bool seq_writer_flush(void *w);
+SEQ_FUNC seq_int_t seq_writer_tell(void *w);
+SEQ_FUNC bool seq_writer_close(void *w);
+SEQ_FUNC void seq_writer_close_all();
 SEQ_FUNC void seq_print(seq_str_t str);
 SEQ_FUNC void seq_print_full(seq_str_t str, FILE *fo);
 
@@ -1,10 +1,15 @@
 #include "dsl/plugins.h"
 #include "parser/parser.h"
 #include "seq/seq.h"
+#include "sir/analyze/module/profile.h"
+#include "sir/llvm/compile_cache.h"
 #include "sir/llvm/llvisitor.h"
+#include "sir/transform/folding/folding.h"
 #include "sir/transform/manager.h"
 #include "sir/transform/pass.h"
+#include "sir/transform/pgo/inlining.h"
 #include "util/common.h"
+#include "util/stats.h"
 #include "llvm/Support/CommandLine.h"
 #include <algorithm>
 #include <chrono>
@@ -13,6 +18,8 @@
 #include <unordered_map>
 #include <vector>
 
+extern char **environ;
+
 namespace {
 void versMsg(llvm::raw_ostream &out) {
   out << "Seq " << SEQ_VERSION_MAJOR << "." << SEQ_VERSION_MINOR << "."
@@ -61,7 +68,19 @@ int docMode(const std::vector<const char *> &args, const std::string &argv0) {
   return EXIT_SUCCESS;
 }
 
-ProcessResult processSource(const std::vector<const char *> &args) {
+int snapshotMode(const std::vector<const char *> &args, const std::string &argv0) {
+  llvm::cl::opt<std::string> input(llvm::cl::Positional,
+                                   llvm::cl::desc("<standard library directory>"),
+                                   llvm::cl::Required);
+  llvm::cl::opt<std::string> output("o", llvm::cl::desc("Write snapshot to specified file"),
+                                    llvm::cl::init("stdlib.snap"));
+  llvm::cl::ParseCommandLineOptions(args.size(), args.data());
+  return seq::generateSnapshot(argv0, input, output) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+ProcessResult processSource(const std::vector<const char *> &args,
+                            const llvm::cl::opt<std::string> *cacheDir = nullptr,
+                            const llvm::cl::opt<bool> *lazy = nullptr) {
   llvm::cl::opt<std::string> input(llvm::cl::Positional, llvm::cl::desc("<input file>"),
                                    llvm::cl::init("-"));
   llvm::cl::opt<OptMode> optMode(
@@ -78,6 +97,22 @@ ProcessResult processSource(const std::vector<const char *> &args) {
   llvm::cl::list<std::string> disabledOpts(
       "disable-opt", llvm::cl::desc("Disable the specified IR optimization"));
   llvm::cl::list<std::string> dsls("dsl", llvm::cl::desc("Use specified DSL"));
+  llvm::cl::opt<unsigned> irJobs(
+      "ir-jobs",
+      llvm::cl::desc("Run function-level IR passes and analyses using N threads "
+                     "(0 for all available cores)"),
+      llvm::cl::value_desc("N"), llvm::cl::init(1));
+  llvm::cl::opt<std::string> profileUse(
+      "profile-use",
+      llvm::cl::desc("Optimize using the specified profile (merged by llvm-profdata "
+                     "from the output of a -profile-generate build)"),
+      llvm::cl::value_desc("file"));
+  llvm::cl::opt<std::string> compileStats(
+      "compile-stats",
+      llvm::cl::desc("Write the time and memory used by each compiler phase, IR pass, "
+                     "realization and LLVM function to the specified JSON file "
+                     "(-time-passes prints a report instead)"),
+      llvm::cl::value_desc("file"));
 
   llvm::cl::ParseCommandLineOptions(args.size(), args.data());
 
@@ -107,22 +142,69 @@ ProcessResult processSource(const std::vector<const char *> &args) {
     defmap.emplace(name, value);
   }
 
+  if (llvm::TimePassesIsEnabled || !compileStats.empty())
+    seq::CompileStats::instance().enable(llvm::TimePassesIsEnabled, compileStats);
+
+  const bool isDebug = (optMode == OptMode::Debug);
+  auto visitor = std::make_unique<seq::ir::LLVMVisitor>(isDebug);
+  if (!isDebug)
+    visitor->setProfileUse(profileUse);
+
+  // the cache does not track profile contents, so profiled compilations bypass it;
+  // cache entries are optimized as a whole, which -lazy exists to avoid
+  std::unique_ptr<seq::ir::CompilationCache> cache;
+  if (cacheDir && input != "-" && profileUse.empty() && !(lazy && *lazy)) {
+    std::string dir = *cacheDir;
+    if (dir.empty()) {
+      if (const char *env = getenv("SEQ_CACHE_DIR"))
+        dir = env;
+    }
+    if (!dir.empty()) {
+      std::vector<std::string> config = {isDebug ? "debug" : "release",
+                                         "cpu:" + visitor->getTargetCPU(),
+                                         "features:" + visitor->getTargetFeatures()};
+      for (const auto &define : defmap)
+        config.push_back("D:" + define.first + "=" + define.second);
+      for (const auto &opt : disabledOpts)
+        config.push_back("disable-opt:" + opt);
+      for (const auto &dsl : dsls)
+        config.push_back("dsl:" + dsl);
+      cache = std::make_unique<seq::ir::CompilationCache>(dir, input, config);
+
+      auto bitcode = cache->lookup();
+      if (!bitcode.empty() && visitor->readBitcodeFile(bitcode)) {
+        LOG_TIME("[T] cache hit = {}", bitcode);
+        return {std::move(visitor), input};
+      }
+    }
+  }
+
   auto *module = seq::parse(args[0], input.c_str(), /*code=*/"", /*isCode=*/false,
                             /*isTest=*/false, /*startLine=*/0, defmap);
   if (!module)
     return {{}, {}};
 
-  const bool isDebug = (optMode == OptMode::Debug);
   auto t = std::chrono::high_resolution_clock::now();
 
   std::vector<std::string> disabledOptsVec(disabledOpts);
   seq::ir::transform::PassManager pm(isDebug, disabledOptsVec);
+  pm.setThreads(irJobs);
   seq::PluginManager plm(&pm, isDebug);
 
   // load Seq
   seq::Seq seqDSL;
   plm.load(&seqDSL);
 
+  if (!profileUse.empty() && !isDebug) {
+    using seq::ir::transform::folding::FoldingPassGroup;
+    auto profileKey = pm.registerAnalysis(
+        std::make_unique<seq::ir::analyze::module::ProfileAnalysis>(profileUse));
+    pm.registerPass(std::make_unique<seq::ir::transform::pgo::ProfileGuidedInlining>(
+                        profileKey),
+                    pm.isDisabled(FoldingPassGroup::KEY) ? "" : FoldingPassGroup::KEY,
+                    {profileKey});
+  }
+
   LOG_TIME("[T] ir-setup = {:.1f}",
            std::chrono::duration_cast<std::chrono::milliseconds>(
                std::chrono::high_resolution_clock::now() - t)
@@ -156,8 +238,10 @@ ProcessResult processSource(const std::vector<const char *> &args) {
                                       1000.0);
 
   t = std::chrono::high_resolution_clock::now();
-  auto visitor = std::make_unique<seq::ir::LLVMVisitor>(isDebug);
-  visitor->visit(module);
+  {
+    seq::CompileStats::Timer timer("llvm", "visitor");
+    visitor->visit(module);
+  }
   LOG_TIME("[T] ir-visitor = {:.1f}",
            std::chrono::duration_cast<std::chrono::milliseconds>(
                std::chrono::high_resolution_clock::now() - t)
@@ -165,6 +249,8 @@ ProcessResult processSource(const std::vector<const char *> &args) {
                1000.0);
   if (_dbg_level)
     visitor->dump();
+  if (cache)
+    cache->store(module, *visitor);
   return {std::move(visitor), input};
 }
 
@@ -173,8 +259,18 @@ int runMode(const std::vector<const char *> &args) {
       "l", llvm::cl::desc("Load and link the specified library"));
   llvm::cl::list<std::string> seqArgs(llvm::cl::ConsumeAfter,
                                       llvm::cl::desc("<program arguments>..."));
+  llvm::cl::opt<std::string> cacheDir(
+      "cache-dir", llvm::cl::desc("Cache optimized programs in the specified directory "
+                                  "(defaults to $SEQ_CACHE_DIR, if set; "
+                                  "ignored with -lazy)"));
+  llvm::cl::opt<bool> lazy(
+      "lazy", llvm::cl::desc("Compile functions lazily when they are first called; "
+                             "starts faster but generates less optimized code"));
+  llvm::cl::opt<unsigned> jobs(
+      "jobs", llvm::cl::desc("Number of compile threads for -lazy (0 for all cores)"),
+      llvm::cl::value_desc("N"), llvm::cl::init(0));
   auto start_t = std::chrono::high_resolution_clock::now();
-  auto result = processSource(args);
+  auto result = processSource(args, &cacheDir, &lazy);
   if (!result.visitor)
     return EXIT_FAILURE;
   std::vector<std::string> libsVec(libs);
@@ -185,7 +281,12 @@ int runMode(const std::vector<const char *> &args) {
                std::chrono::high_resolution_clock::now() - start_t)
                    .count() /
                1000.0);
-  result.visitor->run(argsVec, libsVec);
+  if (lazy) {
+    result.visitor->setJobs(jobs);
+    result.visitor->runLazy(argsVec, libsVec);
+  } else {
+    result.visitor->run(argsVec, libsVec, environ);
+  }
   return EXIT_SUCCESS;
 }
 
@@ -206,10 +307,38 @@ int buildMode(const std::vector<const char *> &args) {
       llvm::cl::desc(
           "Write compiled output to specified file. Supported extensions: "
           "none (executable), .o (object file), .ll (LLVM IR), .bc (LLVM bitcode)"));
+  llvm::cl::opt<unsigned> jobs(
+      "jobs",
+      llvm::cl::desc("Optimize and generate code for object files and executables "
+                     "using N threads (0 for all available cores)"),
+      llvm::cl::value_desc("N"), llvm::cl::init(1));
+  llvm::cl::opt<bool> multiversion(
+      "multiversion",
+      llvm::cl::desc("Generate SSE4.2, AVX2 and AVX-512 versions of functions with "
+                     "loops and pick one at runtime (x86-64 release builds only)"));
+  llvm::cl::opt<std::string> profileGenerate(
+      "profile-generate", llvm::cl::ValueOptional,
+      llvm::cl::desc("Instrument the program to write an execution profile to the "
+                     "specified file (default_%m.profraw if none is given)"),
+      llvm::cl::value_desc("file"));
+  llvm::cl::opt<std::string> cacheDir(
+      "cache-dir",
+      llvm::cl::desc("Build release object files and executables incrementally, "
+                     "caching separately compiled source files in the specified "
+                     "directory"));
 
   auto result = processSource(args);
   if (!result.visitor)
     return EXIT_FAILURE;
+  result.visitor->setJobs(jobs);
+  result.visitor->setMultiversion(multiversion);
+  if (profileGenerate.getNumOccurrences()) {
+    std::string profile = profileGenerate;
+    result.visitor->setProfileGenerate(profile.empty() ? "default_%m.profraw" : profile);
+  }
+  // unlike the run cache, this changes how programs are optimized, so it is never
+  // enabled implicitly by $SEQ_CACHE_DIR
+  result.visitor->setCacheDir(cacheDir);
   std::vector<std::string> libsVec(libs);
 
   if (output.empty() && result.input == "-")
@@ -258,7 +387,7 @@ int buildMode(const std::vector<const char *> &args) {
 }
 
 void showCommandsAndExit() {
-  seq::compilationError("Available commands: seqc <run|build|doc>");
+  seq::compilationError("Available commands: seqc <run|build|doc|snapshot>");
 }
 
 int otherMode(const std::vector<const char *> &args) {
@@ -266,7 +395,8 @@ int otherMode(const std::vector<const char *> &args) {
   llvm::cl::extrahelp("\nMODES:\n\n"
                       "  run   - run a program interactively\n"
                       "  build - build a program\n"
-                      "  doc   - generate program documentation\n");
+                      "  doc   - generate program documentation\n"
+                      "  snapshot - pre-parse the standard library\n");
   llvm::cl::ParseCommandLineOptions(args.size(), args.data());
 
   if (!input.empty())
@@ -298,5 +428,10 @@ int main(int argc, const char **argv) {
     args[0] = argv0.data();
     return docMode(args, oldArgv0);
   }
+  if (mode == "snapshot") {
+    const char *oldArgv0 = args[0];
+    args[0] = argv0.data();
+    return snapshotMode(args, oldArgv0);
+  }
   return otherMode({argv, argv + argc});
 }
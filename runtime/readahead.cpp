@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "lib.h"
+
+/*
+ * Read-ahead decompression
+ *
+ * Compressed input is decompressed on a background thread into a ring of buffers,
+ * so that decompression overlaps with parsing. BGZF input is additionally
+ * decompressed block-parallel on HTSlib's thread pool; plain gzip and uncompressed
+ * input go through the same interface.
+ *
+ * Seeking stops the background thread, which is only restarted by the next read,
+ * so that seeking back and forth between reads costs no decompression. Uncompressed
+ * input and BGZF input with a .gzi index are repositioned directly; other gzip
+ * input has to be decompressed again from the start up to the target.
+ */
+
+struct BGZF;
+extern "C" {
+BGZF *bgzf_open(const char *path, const char *mode);
+int bgzf_mt(BGZF *fp, int n_threads, int n_sub_blks);
+ssize_t bgzf_read(BGZF *fp, void *data, size_t length);
+int bgzf_close(BGZF *fp);
+int bgzf_compression(BGZF *fp);
+int bgzf_index_load(BGZF *fp, const char *bname, const char *suffix);
+int bgzf_useek(BGZF *fp, off_t uoffset, int where);
+}
+
+namespace {
+const size_t RING_BUFFER_SIZE = 1 << 22;
+const size_t RING_BUFFERS = 4;
+// bgzf_compression() results
+const int NO_COMPRESSION = 0;
+const int BGZF_COMPRESSION = 2;
+// decompression threads per reader; more would outpace any parser and only
+// oversubscribe the cores the parser's own threads run on
+const int MAX_THREADS = 4;
+
+class ReadAhead {
+private:
+  struct Chunk {
+    size_t index;
+    ssize_t len;
+  };
+
+  std::string path;
+  int threads;
+  BGZF *fp;
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<std::unique_ptr<char[]>> buffers;
+  std::deque<size_t> idle;
+  std::deque<Chunk> filled;
+  bool stop;
+  // position to resume reading from once the worker restarts, or -1 if it runs
+  seq_int_t pending;
+  // whether the BGZF index has been looked for, and was found
+  bool indexChecked;
+  bool indexed;
+
+  // the chunk being consumed, if any
+  bool hasCurrent;
+  Chunk current;
+  size_t offset;
+
+  bool open() {
+    fp = bgzf_open(path.c_str(), "r");
+    if (!fp)
+      return false;
+    if (threads > 1 && bgzf_compression(fp) == BGZF_COMPRESSION)
+      bgzf_mt(fp, threads, 256);
+    return true;
+  }
+
+  void run(seq_int_t skip) {
+    while (true) {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return stop || !idle.empty(); });
+        if (stop)
+          return;
+        index = idle.front();
+        idle.pop_front();
+      }
+
+      ssize_t len = bgzf_read(fp, buffers[index].get(), RING_BUFFER_SIZE);
+      if (len > 0 && skip > 0) {
+        // bytes before a seek target are decompressed and dropped
+        auto n = std::min((seq_int_t)len, skip);
+        skip -= n;
+        if (n < len)
+          memmove(buffers[index].get(), buffers[index].get() + n, len - n);
+        len -= n;
+        if (len == 0) {
+          std::lock_guard<std::mutex> lock(mutex);
+          idle.push_back(index);
+          continue;
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        filled.push_back({index, len});
+      }
+      cv.notify_all();
+      if (len <= 0)
+        return;
+    }
+  }
+
+  // repositions the file directly, if its format allows it
+  bool useek(seq_int_t pos) {
+    const int compression = bgzf_compression(fp);
+    if (compression == BGZF_COMPRESSION && !indexChecked) {
+      // htslib logs an error for a missing index, so check for it first
+      const std::string gzi = path + ".gzi";
+      indexed = access(gzi.c_str(), R_OK) == 0 &&
+                bgzf_index_load(fp, path.c_str(), ".gzi") == 0;
+      indexChecked = true;
+    }
+    if (compression == NO_COMPRESSION || (compression == BGZF_COMPRESSION && indexed))
+      return bgzf_useek(fp, (off_t)pos, SEEK_SET) == 0;
+    return false;
+  }
+
+  bool resume() {
+    seq_int_t skip = 0;
+    if (!useek(pending)) {
+      bgzf_close(fp);
+      fp = nullptr;
+      indexChecked = indexed = false;
+      if (!open())
+        return false;
+      skip = pending;
+    }
+    pending = -1;
+    start(skip);
+    return true;
+  }
+
+  void start(seq_int_t skip) {
+    stop = false;
+    hasCurrent = false;
+    offset = 0;
+    idle.clear();
+    filled.clear();
+    for (size_t i = 0; i < buffers.size(); i++)
+      idle.push_back(i);
+    worker = std::thread([this, skip] { run(skip); });
+  }
+
+  void halt() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv.notify_all();
+    if (worker.joinable())
+      worker.join();
+  }
+
+public:
+  ReadAhead(std::string path, int threads)
+      : path(std::move(path)), threads(threads), fp(nullptr), worker(), mutex(), cv(),
+        buffers(), idle(), filled(), stop(false), pending(-1), indexChecked(false),
+        indexed(false), hasCurrent(false), current(), offset(0) {
+    for (size_t i = 0; i < RING_BUFFERS; i++)
+      buffers.emplace_back(new char[RING_BUFFER_SIZE]);
+  }
+
+  ~ReadAhead() {
+    halt();
+    if (fp)
+      bgzf_close(fp);
+  }
+
+  bool init() {
+    if (!open())
+      return false;
+    start(0);
+    return true;
+  }
+
+  seq_int_t read(char *buf, seq_int_t n) {
+    if (!fp || (pending >= 0 && !resume()))
+      return -1;
+    if (!hasCurrent) {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this] { return !filled.empty(); });
+      current = filled.front();
+      filled.pop_front();
+      hasCurrent = true;
+      offset = 0;
+    }
+    if (current.len <= 0) {
+      // end of input or error; leave the chunk in place for later calls
+      return current.len < 0 ? -1 : 0;
+    }
+
+    auto len = std::min((seq_int_t)(current.len - offset), n);
+    memcpy(buf, buffers[current.index].get() + offset, len);
+    offset += len;
+    if (offset == (size_t)current.len) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(current.index);
+        hasCurrent = false;
+      }
+      cv.notify_all();
+    }
+    return len;
+  }
+
+  bool seek(seq_int_t pos) {
+    if (!fp || pos < 0)
+      return false;
+    halt();
+    pending = pos;
+    return true;
+  }
+};
+} // namespace
+
+SEQ_FUNC void *seq_readahead_open(const char *path, seq_int_t threads) {
+  if (threads <= 0)
+    threads = std::min(MAX_THREADS, (int)std::thread::hardware_concurrency());
+  threads = std::max(threads, (seq_int_t)1);
+  auto *r = new ReadAhead(path, (int)threads);
+  if (!r->init()) {
+    delete r;
+    return nullptr;
+  }
+  return r;
+}
+
+SEQ_FUNC seq_int_t seq_readahead_read(void *r, char *buf, seq_int_t n) {
+  return ((ReadAhead *)r)->read(buf, n);
+}
+
+SEQ_FUNC bool seq_readahead_seek(void *r, seq_int_t pos) {
+  return ((ReadAhead *)r)->seek(pos);
+}
+
+SEQ_FUNC void seq_readahead_close(void *r) { delete (ReadAhead *)r; }
@@ -1,9 +1,11 @@
 #include "intersw.h"
 #include "ksw2.h"
 #include "lib.h"
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
-#include <string>
+#include <strings.h>
+#include <vector>
 
 // adapted from minimap2's KSW2 dispatch
 // https://github.com/lh3/minimap2/blob/master/ksw2_dispatch.c
@@ -16,6 +18,7 @@
 #define SIMD_AVX 0x40
 #define SIMD_AVX2 0x80
 #define SIMD_AVX512F 0x100
+#define SIMD_AVX512BW 0x200
 
 #ifndef _MSC_VER
 // adapted from
@@ -33,22 +36,14 @@ void __cpuidex(int cpuid[4], int func_id, int subfunc_id) {
 }
 #endif
 
-static int intersw_simd = -1;
-
-static int SEQ_MAXSIMD = (SIMD_AVX512F << 1) - 1;
+// register states enabled by the OS (XCR0)
+static uint64_t xgetbv0() {
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+}
 
 static int x86_simd() {
-  // char *env = getenv("SEQ_SWSIMD");
-  // int SEQ_MAXSIMD = (SIMD_AVX512F << 1) - 1;
-  // if (env && std::string(env) == "AVX2")
-  //   SEQ_MAXSIMD = (SIMD_AVX2 << 1) - 1;
-  // if (env && std::string(env) == "AVX")
-  //   SEQ_MAXSIMD = (SIMD_AVX << 1) - 1;
-  // if (env && std::string(env) == "AVX512")
-  //   SEQ_MAXSIMD = (SIMD_AVX512F << 1) - 1;
-  // if (env && std::string(env) == "SSE4_2")
-  //   SEQ_MAXSIMD = (SIMD_SSE4_2 << 1) - 1;
-
   int flag = 0, cpuid[4], max_id;
   __cpuidex(cpuid, 0, 0);
   max_id = cpuid[0];
@@ -56,46 +51,143 @@ static int x86_simd() {
     return 0;
   __cpuidex(cpuid, 1, 0);
   if (cpuid[3] >> 25 & 1)
-    flag |= SIMD_SSE & SEQ_MAXSIMD;
+    flag |= SIMD_SSE;
   if (cpuid[3] >> 26 & 1)
-    flag |= SIMD_SSE2 & SEQ_MAXSIMD;
+    flag |= SIMD_SSE2;
   if (cpuid[2] >> 0 & 1)
-    flag |= SIMD_SSE3 & SEQ_MAXSIMD;
+    flag |= SIMD_SSE3;
   if (cpuid[2] >> 9 & 1)
-    flag |= SIMD_SSSE3 & SEQ_MAXSIMD;
+    flag |= SIMD_SSSE3;
   if (cpuid[2] >> 19 & 1)
-    flag |= SIMD_SSE4_1 & SEQ_MAXSIMD;
+    flag |= SIMD_SSE4_1;
   if (cpuid[2] >> 20 & 1)
-    flag |= SIMD_SSE4_2 & SEQ_MAXSIMD;
+    flag |= SIMD_SSE4_2;
   if (cpuid[2] >> 28 & 1)
-    flag |= SIMD_AVX & SEQ_MAXSIMD;
+    flag |= SIMD_AVX;
+  const bool osxsave = cpuid[2] >> 27 & 1;
   if (max_id >= 7) {
     __cpuidex(cpuid, 7, 0);
     if (cpuid[1] >> 5 & 1)
-      flag |= SIMD_AVX2 & SEQ_MAXSIMD;
+      flag |= SIMD_AVX2;
     if (cpuid[1] >> 16 & 1)
-      flag |= SIMD_AVX512F & SEQ_MAXSIMD;
+      flag |= SIMD_AVX512F;
+    if (cpuid[1] >> 30 & 1)
+      flag |= SIMD_AVX512BW;
   }
+
+  // AVX and AVX-512 registers are only usable if the OS saves them
+  const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+  if ((xcr0 & 0x6) != 0x6)
+    flag &= ~(SIMD_AVX | SIMD_AVX2 | SIMD_AVX512F | SIMD_AVX512BW);
+  if ((xcr0 & 0xe6) != 0xe6)
+    flag &= ~(SIMD_AVX512F | SIMD_AVX512BW);
   return flag;
 }
 
-SEQ_FUNC seq_str_t seq_get_interaln_simd() {
-  if (intersw_simd < 0)
-    intersw_simd = x86_simd();
-  if (intersw_simd & SIMD_AVX512F) {
-    return string_conv("%s", 10, "AVX512");
-  } else if (intersw_simd & SIMD_AVX2) {
-    return string_conv("%s", 10, "AVX2");
-  } else if (intersw_simd & SIMD_SSE4_1) {
-    return string_conv("%s", 10, "SSE4_1");
-  } else {
-    return string_conv("%s", 10, "NONE");
+// SIMD capabilities used to dispatch multiversioned functions (see
+// compiler/sir/llvm/multiversion.cpp)
+SEQ_FUNC int seq_cpu_simd() {
+  static const int cpu_simd = x86_simd();
+  return cpu_simd;
+}
+
+/*
+ * Kernel dispatch
+ *
+ * The inter-sequence kernels are built for each of the ISAs below, and the best
+ * one the CPU supports is chosen at first use. SEQ_SWSIMD=<ISA name> or
+ * seq_set_interaln_simd() caps the choice, e.g. to compare kernels on one
+ * machine, or to use the same ISA on every node of a heterogeneous cluster.
+ * Calls and aligned pairs are counted per kernel and ISA.
+ */
+
+enum InterSWISA { ISA_NONE, ISA_SSE4_1, ISA_AVX2, ISA_AVX512, NUM_ISAS };
+
+// must be consistent with bio/align.seq
+enum InterSWKernel { KERNEL_ALIGN1, KERNEL_ALIGN16, KERNEL_ALIGN128, NUM_KERNELS };
+
+static const char *const ISA_NAMES[NUM_ISAS] = {"NONE", "SSE4_1", "AVX2", "AVX512"};
+static const int ISA_FLAGS[NUM_ISAS] = {0, SIMD_SSE4_1, SIMD_AVX2, SIMD_AVX512BW};
+
+static std::atomic<int> intersw_isa(-1);
+static std::atomic<seq_int_t> kernel_calls[NUM_KERNELS][NUM_ISAS];
+static std::atomic<seq_int_t> kernel_pairs[NUM_KERNELS][NUM_ISAS];
+
+static int isaByName(const char *name) {
+  for (int isa = 0; isa < NUM_ISAS; isa++) {
+    if (strcasecmp(name, ISA_NAMES[isa]) == 0)
+      return isa;
+  }
+  // names accepted by earlier versions; there are no separate builds for these
+  if (strcasecmp(name, "SSE4_2") == 0 || strcasecmp(name, "AVX") == 0)
+    return ISA_SSE4_1;
+  return -1;
+}
+
+// best ISA up to max that the CPU supports
+static int bestISA(int max) {
+  const int simd = seq_cpu_simd();
+  int best = ISA_NONE;
+  for (int isa = ISA_NONE + 1; isa <= max; isa++) {
+    if (simd & ISA_FLAGS[isa])
+      best = isa;
   }
+  return best;
+}
+
+static int interswISA() {
+  int isa = intersw_isa.load(std::memory_order_relaxed);
+  if (isa >= 0)
+    return isa;
+  int max = NUM_ISAS - 1;
+  if (const char *env = getenv("SEQ_SWSIMD")) {
+    int requested = isaByName(env);
+    if (requested >= 0)
+      max = requested;
+  }
+  int expected = -1;
+  intersw_isa.compare_exchange_strong(expected, bestISA(max));
+  return intersw_isa.load(std::memory_order_relaxed);
+}
+
+static void countCall(InterSWKernel kernel, int isa, int numPairs) {
+  kernel_calls[kernel][isa].fetch_add(1, std::memory_order_relaxed);
+  kernel_pairs[kernel][isa].fetch_add(numPairs, std::memory_order_relaxed);
+}
+
+SEQ_FUNC seq_str_t seq_get_interaln_simd() {
+  const char *name = ISA_NAMES[interswISA()];
+  return string_conv("%s", 10, name);
+}
+
+// caps the ISA as SEQ_SWSIMD does; false if the name is not known
+SEQ_FUNC bool seq_set_interaln_simd(const char *name) {
+  int max = isaByName(name);
+  if (max < 0)
+    return false;
+  intersw_isa.store(bestISA(max), std::memory_order_relaxed);
+  return true;
 }
 
+// caps the ISA by SIMD_* flag, as used by the benchmarks
 SEQ_FUNC void seq_set_sw_maxsimd(int max) {
-  SEQ_MAXSIMD = (max << 1) - 1;
-  intersw_simd = x86_simd();
+  int mask = (max << 1) - 1;
+  if (mask & SIMD_AVX512F)
+    mask |= SIMD_AVX512BW;
+  int isa = ISA_NONE;
+  for (int i = ISA_NONE + 1; i < NUM_ISAS; i++) {
+    if (ISA_FLAGS[i] & mask)
+      isa = i;
+  }
+  intersw_isa.store(bestISA(isa), std::memory_order_relaxed);
+}
+
+SEQ_FUNC seq_int_t seq_interaln_calls(seq_int_t kernel, seq_int_t isa) {
+  return kernel_calls[kernel][isa].load(std::memory_order_relaxed);
+}
+
+SEQ_FUNC seq_int_t seq_interaln_pairs(seq_int_t kernel, seq_int_t isa) {
+  return kernel_pairs[kernel][isa].load(std::memory_order_relaxed);
 }
 
 struct InterAlignParams { // must be consistent with bio/align.seq
@@ -110,25 +202,6 @@ struct InterAlignParams { // must be consistent with bio/align.seq
   int32_t end_bonus;
 };
 
-template <typename SW8, typename SWbt8>
-static inline void seq_inter_align128_generic(InterAlignParams *paramsx,
-                                              SeqPair *seqPairArray, uint8_t *seqBufRef,
-                                              uint8_t *seqBufQer, int numPairs) {
-  InterAlignParams params = *paramsx;
-  const int8_t bandwidth =
-      (0 <= params.bandwidth && params.bandwidth < 0xff) ? params.bandwidth : 0x7f;
-  const int8_t zdrop = (0 <= params.zdrop && params.zdrop < 0xff) ? params.zdrop : 0x7f;
-  if (params.score_only) {
-    SW8 bsw(params.gapo, params.gape, params.gapo, params.gape, zdrop, params.end_bonus,
-            params.a, params.b, params.ambig);
-    bsw.SW(seqPairArray, seqBufRef, seqBufQer, numPairs, bandwidth);
-  } else {
-    SWbt8 bsw(params.gapo, params.gape, params.gapo, params.gape, zdrop,
-              params.end_bonus, params.a, params.b, params.ambig);
-    bsw.SW(seqPairArray, seqBufRef, seqBufQer, numPairs, bandwidth);
-  }
-}
-
 template <typename SW16, typename SWbt16>
 static inline void seq_inter_align16_generic(InterAlignParams *paramsx,
                                              SeqPair *seqPairArray, uint8_t *seqBufRef,
@@ -149,8 +222,46 @@ static inline void seq_inter_align16_generic(InterAlignParams *paramsx,
   }
 }
 
-SEQ_FUNC void seq_inter_align1(InterAlignParams *paramsx, SeqPair *seqPairArray,
-                               uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
+template <typename SW8, typename SWbt8, typename SW16, typename SWbt16>
+static inline void seq_inter_align128_generic(InterAlignParams *paramsx,
+                                              SeqPair *seqPairArray, uint8_t *seqBufRef,
+                                              uint8_t *seqBufQer, int numPairs) {
+  InterAlignParams params = *paramsx;
+  // sequences are shorter than 128, so larger bands and drop-offs never apply
+  const int8_t bandwidth =
+      (0 <= params.bandwidth && params.bandwidth < 0x7f) ? params.bandwidth : 0x7f;
+  const int8_t zdrop = (0 <= params.zdrop && params.zdrop < 0x7f) ? params.zdrop : 0x7f;
+  if (params.score_only) {
+    SW8 bsw(params.gapo, params.gape, params.gapo, params.gape, zdrop, params.end_bonus,
+            params.a, params.b, params.ambig);
+    bsw.SW(seqPairArray, seqBufRef, seqBufQer, numPairs, bandwidth);
+  } else {
+    SWbt8 bsw(params.gapo, params.gape, params.gapo, params.gape, zdrop,
+              params.end_bonus, params.a, params.b, params.ambig);
+    bsw.SW(seqPairArray, seqBufRef, seqBufQer, numPairs, bandwidth);
+  }
+
+  // realign pairs whose scores did not fit in 8 bits with 16-bit scores
+  std::vector<SeqPair> overflow;
+  std::vector<int> index;
+  for (int i = 0; i < numPairs; i++) {
+    SeqPair &sp = seqPairArray[i];
+    if (sp.flags & SEQ_INTER_OVERFLOW) {
+      sp.flags &= ~SEQ_INTER_OVERFLOW;
+      overflow.push_back(sp);
+      index.push_back(i);
+    }
+  }
+  if (overflow.empty())
+    return;
+  seq_inter_align16_generic<SW16, SWbt16>(paramsx, overflow.data(), seqBufRef, seqBufQer,
+                                          (int)overflow.size());
+  for (size_t i = 0; i < overflow.size(); i++)
+    seqPairArray[index[i]] = overflow[i];
+}
+
+static void interAlign1(InterAlignParams *paramsx, SeqPair *seqPairArray,
+                        uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
   typedef InterSW<128, 8, /*CIGAR=*/false> SW8;
   InterAlignParams params = *paramsx;
   int8_t a = params.a > 0 ? params.a : -params.a;
@@ -174,53 +285,70 @@ SEQ_FUNC void seq_inter_align1(InterAlignParams *paramsx, SeqPair *seqPairArray,
   }
 }
 
+// ksw2 has a single build, so pairs aligned one at a time are not dispatched
+SEQ_FUNC void seq_inter_align1(InterAlignParams *paramsx, SeqPair *seqPairArray,
+                               uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
+  countCall(KERNEL_ALIGN1, ISA_NONE, numPairs);
+  interAlign1(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+}
+
 void seq_inter_align128_scalar(InterAlignParams *paramsx, SeqPair *seqPairArray,
                                uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
-  seq_inter_align1(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+  interAlign1(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
 }
 
 void seq_inter_align128_sse2(InterAlignParams *paramsx, SeqPair *seqPairArray,
                              uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
   typedef InterSW<128, 8, /*CIGAR=*/false> SW8;
   typedef InterSW<128, 8, /*CIGAR=*/true> SWbt8;
-  seq_inter_align128_generic<SW8, SWbt8>(paramsx, seqPairArray, seqBufRef, seqBufQer,
-                                         numPairs);
+  typedef InterSW<128, 16, /*CIGAR=*/false> SW16;
+  typedef InterSW<128, 16, /*CIGAR=*/true> SWbt16;
+  seq_inter_align128_generic<SW8, SWbt8, SW16, SWbt16>(paramsx, seqPairArray, seqBufRef,
+                                                       seqBufQer, numPairs);
 }
 
 void seq_inter_align128_avx2(InterAlignParams *paramsx, SeqPair *seqPairArray,
                              uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
   typedef InterSW<256, 8, /*CIGAR=*/false> SW8;
   typedef InterSW<256, 8, /*CIGAR=*/true> SWbt8;
-  seq_inter_align128_generic<SW8, SWbt8>(paramsx, seqPairArray, seqBufRef, seqBufQer,
-                                         numPairs);
+  typedef InterSW<256, 16, /*CIGAR=*/false> SW16;
+  typedef InterSW<256, 16, /*CIGAR=*/true> SWbt16;
+  seq_inter_align128_generic<SW8, SWbt8, SW16, SWbt16>(paramsx, seqPairArray, seqBufRef,
+                                                       seqBufQer, numPairs);
 }
 
 void seq_inter_align128_avx512(InterAlignParams *paramsx, SeqPair *seqPairArray,
                                uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
   typedef InterSW<512, 8, /*CIGAR=*/false> SW8;
   typedef InterSW<512, 8, /*CIGAR=*/true> SWbt8;
-  seq_inter_align128_generic<SW8, SWbt8>(paramsx, seqPairArray, seqBufRef, seqBufQer,
-                                         numPairs);
+  typedef InterSW<512, 16, /*CIGAR=*/false> SW16;
+  typedef InterSW<512, 16, /*CIGAR=*/true> SWbt16;
+  seq_inter_align128_generic<SW8, SWbt8, SW16, SWbt16>(paramsx, seqPairArray, seqBufRef,
+                                                       seqBufQer, numPairs);
 }
 
 SEQ_FUNC void seq_inter_align128(InterAlignParams *paramsx, SeqPair *seqPairArray,
                                  uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
-  if (intersw_simd < 0)
-    intersw_simd = x86_simd();
-  if (intersw_simd & SIMD_AVX512F) {
+  const int isa = interswISA();
+  countCall(KERNEL_ALIGN128, isa, numPairs);
+  switch (isa) {
+  case ISA_AVX512:
     seq_inter_align128_avx512(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
-  } else if (intersw_simd & SIMD_AVX2) {
+    break;
+  case ISA_AVX2:
     seq_inter_align128_avx2(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
-  } else if (intersw_simd & SIMD_SSE4_1) {
+    break;
+  case ISA_SSE4_1:
     seq_inter_align128_sse2(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
-  } else {
+    break;
+  default:
     seq_inter_align128_scalar(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
   }
 }
 
 void seq_inter_align16_scalar(InterAlignParams *paramsx, SeqPair *seqPairArray,
                               uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
-  seq_inter_align1(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
+  interAlign1(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
 }
 
 void seq_inter_align16_sse2(InterAlignParams *paramsx, SeqPair *seqPairArray,
@@ -249,15 +377,19 @@ void seq_inter_align16_avx512(InterAlignParams *paramsx, SeqPair *seqPairArray,
 
 SEQ_FUNC void seq_inter_align16(InterAlignParams *paramsx, SeqPair *seqPairArray,
                                 uint8_t *seqBufRef, uint8_t *seqBufQer, int numPairs) {
-  if (intersw_simd < 0)
-    intersw_simd = x86_simd();
-  if (intersw_simd & SIMD_AVX512F) {
+  const int isa = interswISA();
+  countCall(KERNEL_ALIGN16, isa, numPairs);
+  switch (isa) {
+  case ISA_AVX512:
     seq_inter_align16_avx512(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
-  } else if (intersw_simd & SIMD_AVX2) {
+    break;
+  case ISA_AVX2:
     seq_inter_align16_avx2(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
-  } else if (intersw_simd & SIMD_SSE4_1) {
+    break;
+  case ISA_SSE4_1:
     seq_inter_align16_sse2(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
-  } else {
+    break;
+  default:
     seq_inter_align16_scalar(paramsx, seqPairArray, seqBufRef, seqBufQer, numPairs);
   }
 }
@@ -24,7 +24,7 @@ extern "C" void *seq_alloc_atomic(size_t n);
 extern "C" void *seq_realloc(void *p, size_t n);
 extern "C" void seq_free(void *p);
 
-void pv(const char *tag, __m256i var) {
+__attribute__((target("avx"))) void pv(const char *tag, __m256i var) {
   int16_t *val = (int16_t *)&var;
   printf("%s: %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d\n", tag, val[0], val[1],
          val[2], val[3], val[4], val[5], val[6], val[7], val[8], val[9], val[10],
@@ -56,6 +56,11 @@ struct SeqPair {
 #define DUMMY1 99
 #define DUMMY2 100
 
+// Set in a pair's flags by the 8-bit kernels if its scores may not have fit in
+// 8 bits, in which case its result is not valid and it has to be realigned with
+// 16-bit scores (see seq_inter_align128 in intersw.cpp).
+#define SEQ_INTER_OVERFLOW 0x40000000
+
 template <unsigned W, unsigned N> struct SIMD {};
 
 template <> struct SIMD<128, 8> {
@@ -87,6 +92,10 @@ template <> struct SIMD<128, 8> {
 
   static ALWAYS_INLINE Vec sub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
 
+  static ALWAYS_INLINE Vec adds(Vec a, Vec b) { return _mm_adds_epi8(a, b); }
+
+  static ALWAYS_INLINE Vec subs(Vec a, Vec b) { return _mm_subs_epi8(a, b); }
+
   static ALWAYS_INLINE Vec min(Vec a, Vec b) __attribute__((target("sse4.1"))) {
     return _mm_min_epi8(a, b);
   }
@@ -174,6 +183,14 @@ template <> struct SIMD<256, 8> {
     return _mm256_sub_epi8(a, b);
   }
 
+  static ALWAYS_INLINE Vec adds(Vec a, Vec b) __attribute__((target("avx2"))) {
+    return _mm256_adds_epi8(a, b);
+  }
+
+  static ALWAYS_INLINE Vec subs(Vec a, Vec b) __attribute__((target("avx2"))) {
+    return _mm256_subs_epi8(a, b);
+  }
+
   static ALWAYS_INLINE Vec min(Vec a, Vec b) __attribute__((target("avx2"))) {
     return _mm256_min_epi8(a, b);
   }
@@ -278,6 +295,14 @@ template <> struct SIMD<512, 8> {
     return _mm512_sub_epi8(a, b);
   }
 
+  static ALWAYS_INLINE Vec adds(Vec a, Vec b) __attribute__((target("avx512bw"))) {
+    return _mm512_adds_epi8(a, b);
+  }
+
+  static ALWAYS_INLINE Vec subs(Vec a, Vec b) __attribute__((target("avx512bw"))) {
+    return _mm512_subs_epi8(a, b);
+  }
+
   static ALWAYS_INLINE Vec min(Vec a, Vec b) __attribute__((target("avx512bw"))) {
     return _mm512_min_epi8(a, b);
   }
@@ -355,6 +380,10 @@ template <> struct SIMD<128, 16> {
 
   static ALWAYS_INLINE Vec sub(Vec a, Vec b) { return _mm_sub_epi16(a, b); }
 
+  static ALWAYS_INLINE Vec adds(Vec a, Vec b) { return _mm_adds_epi16(a, b); }
+
+  static ALWAYS_INLINE Vec subs(Vec a, Vec b) { return _mm_subs_epi16(a, b); }
+
   static ALWAYS_INLINE Vec min(Vec a, Vec b) { return _mm_min_epi16(a, b); }
 
   static ALWAYS_INLINE Vec max(Vec a, Vec b) { return _mm_max_epi16(a, b); }
@@ -442,6 +471,14 @@ template <> struct SIMD<256, 16> {
     return _mm256_sub_epi16(a, b);
   }
 
+  static ALWAYS_INLINE Vec adds(Vec a, Vec b) __attribute__((target("avx2"))) {
+    return _mm256_adds_epi16(a, b);
+  }
+
+  static ALWAYS_INLINE Vec subs(Vec a, Vec b) __attribute__((target("avx2"))) {
+    return _mm256_subs_epi16(a, b);
+  }
+
   static ALWAYS_INLINE Vec min(Vec a, Vec b) __attribute__((target("avx2"))) {
     return _mm256_min_epi16(a, b);
   }
@@ -546,6 +583,14 @@ template <> struct SIMD<512, 16> {
     return _mm512_sub_epi16(a, b);
   }
 
+  static ALWAYS_INLINE Vec adds(Vec a, Vec b) __attribute__((target("avx512bw"))) {
+    return _mm512_adds_epi16(a, b);
+  }
+
+  static ALWAYS_INLINE Vec subs(Vec a, Vec b) __attribute__((target("avx512bw"))) {
+    return _mm512_subs_epi16(a, b);
+  }
+
   static ALWAYS_INLINE Vec min(Vec a, Vec b) __attribute__((target("avx512bw"))) {
     return _mm512_min_epi16(a, b);
   }
@@ -824,6 +869,7 @@ void InterSW<W, N, CIGAR>::SW(SeqPair *pairArray, uint8_t *seqBufRef,
     uint_t h0[SIMD_WIDTH] __attribute__((aligned(64)));
     uint_t band[SIMD_WIDTH];
     uint_t qlen[SIMD_WIDTH] __attribute__((aligned(64)));
+    int qmax[SIMD_WIDTH]; // maximum score of each query
     bool ext[SIMD_WIDTH];
     uint_t bsize = 0;
 
@@ -833,8 +879,6 @@ void InterSW<W, N, CIGAR>::SW(SeqPair *pairArray, uint8_t *seqBufRef,
     Vec oe_ins128 = S::set(o_ins + e_ins);
     Vec o_del128 = S::set(o_del);
     Vec e_del128 = S::set(e_del);
-    Vec eb_ins128 = S::set(eb - o_ins);
-    Vec eb_del128 = S::set(eb - o_del);
 
     int_t max = 0;
     if (max < w_match)
@@ -868,7 +912,7 @@ void InterSW<W, N, CIGAR>::SW(SeqPair *pairArray, uint8_t *seqBufRef,
           mySeq1SoA[k * SIMD_WIDTH + j] = (seq1[k] == AMBIG ? FF : seq1[k]);
           H2[k * SIMD_WIDTH + j] = 0;
         }
-        qlen[j] = sp.len2 * max;
+        qmax[j] = sp.len2 * max;
         if (maxLen1 < sp.len1)
           maxLen1 = sp.len1;
       }
@@ -883,10 +927,10 @@ void InterSW<W, N, CIGAR>::SW(SeqPair *pairArray, uint8_t *seqBufRef,
 
       Vec h0_128 = S::load((Vec *)h0);
       S::store((Vec *)H2, h0_128);
-      Vec tmp128 = S::sub(h0_128, o_del128);
+      Vec tmp128 = S::subs(h0_128, o_del128);
 
       for (k = 1; k < maxLen1; k++) {
-        tmp128 = S::sub(tmp128, e_del128);
+        tmp128 = S::subs(tmp128, e_del128);
         S::store((Vec *)(H2 + k * SIMD_WIDTH), tmp128);
       }
 
@@ -916,30 +960,26 @@ void InterSW<W, N, CIGAR>::SW(SeqPair *pairArray, uint8_t *seqBufRef,
 
       S::store((Vec *)H1, h0_128);
       Cmp cmp128;
-      tmp128 = S::sub(h0_128, oe_ins128);
+      tmp128 = S::subs(h0_128, oe_ins128);
       S::store((Vec *)(H1 + SIMD_WIDTH), tmp128);
       for (k = 2; k < maxLen2; k++) {
         Vec h1_128 = tmp128;
-        tmp128 = S::sub(h1_128, e_ins128);
+        tmp128 = S::subs(h1_128, e_ins128);
         S::store((Vec *)(H1 + k * SIMD_WIDTH), tmp128);
       }
 
       uint_t myband[SIMD_WIDTH] __attribute__((aligned(64)));
-      uint_t temp[SIMD_WIDTH] __attribute__((aligned(64)));
       {
-        Vec qlen128 = S::load((Vec *)qlen);
-        Vec sum128 = S::add(qlen128, eb_ins128);
-        S::store((Vec *)temp, sum128);
+        // computed as by the 16-bit kernel whatever the score width, since
+        // the maximum query scores need not fit in 8 bits
         for (int l = 0; l < SIMD_WIDTH; l++) {
-          double val = temp[l] / e_ins + 1.0;
+          double val = (uint16_t)(qmax[l] + eb - o_ins) / e_ins + 1.0;
           int max_ins = (int)val;
           max_ins = max_ins > 1 ? max_ins : 1;
           myband[l] = min_(bsize, max_ins);
         }
-        sum128 = S::add(qlen128, eb_del128);
-        S::store((Vec *)temp, sum128);
         for (int l = 0; l < SIMD_WIDTH; l++) {
-          double val = temp[l] / e_del + 1.0;
+          double val = (uint16_t)(qmax[l] + eb - o_del) / e_del + 1.0;
           int max_ins = (int)val;
           max_ins = max_ins > 1 ? max_ins : 1;
           myband[l] = min_(myband[l], max_ins);
@@ -975,7 +1015,14 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
   constexpr int MAX_SEQ_LEN = S::MAX_SEQ_LEN;
   constexpr int SIMD_WIDTH = W / N;
   constexpr uint_t FF = (1 << N) - 1;
-  constexpr int_t NEG_INF = -(1 << (N - 2));
+  // 8-bit scores saturate rather than wrap around, and NEG_INF is the lowest
+  // score, which is kept sticky so that no path can climb out of it. Scores are
+  // then never overestimated, and are exact unless a cell in the band reaches
+  // NEG_INF or a score reaches SAT_MAX; such lanes are flagged with
+  // SEQ_INTER_OVERFLOW instead.
+  constexpr bool SAT = (N == 8);
+  constexpr int_t NEG_INF = SAT ? -(1 << (N - 1)) : -(1 << (N - 2));
+  constexpr int_t SAT_MAX = (1 << (N - 1)) - 1;
 
   Vec match256 = S::set(this->w_match);
   Vec mismatch256 = S::set(this->w_mismatch);
@@ -1015,6 +1062,8 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
   Vec two256 = S::set(2);
   Vec max_ie256 = zero256;
   Vec ff256 = S::set(FF);
+  Vec lo256 = zero256; // smallest score in the band
+  Vec hi256 = zero256; // largest score
 
   Vec tail256 = qlen256, head256 = zero256;
   S::store((Vec *)head, head256);
@@ -1032,6 +1081,13 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
   Vec maxScore256 = hval;
   for (j = 0; j < ncol; j++)
     S::store((Vec *)(F + j * SIMD_WIDTH), init256);
+  if (SAT) { // the boundary row is part of the band too
+    for (int l = 0; l <= ncol; l++) {
+      Vec h256 = S::load((Vec *)(H_h + l * SIMD_WIDTH));
+      Cmp cmp = S::gt(S::set(l), qlen256);
+      lo256 = S::min(lo256, S::blend(h256, zero256, cmp));
+    }
+  }
 
   Vec x256 = zero256;
   Vec y256 = zero256;
@@ -1137,7 +1193,9 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
       Vec tmp256 = S::umax(s10, s2);
       cmp11 = S::vec2cmp(tmp256);
       sbt11 = S::blend(sbt11, w_ambig_256, cmp11);
-      Vec m11 = S::add(h00, sbt11);
+      Vec m11 = SAT ? S::adds(h00, sbt11) : S::add(h00, sbt11);
+      if (SAT)
+        m11 = S::blend(m11, init256, S::eq(h00, init256));
       if (CIGAR) {
         dcmp = S::orc_(S::gt(m11, e11), S::eq(m11, e11));
         d = S::blend(two256, zero256, dcmp);
@@ -1148,18 +1206,20 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
         d = S::blend(one256, d, dcmp);
       }
       h11 = S::max(h11, f11);
-      Vec temp256 = S::sub(m11, oe_ins256);
+      if (SAT)
+        hi256 = S::max(hi256, h11);
+      Vec temp256 = SAT ? S::subs(m11, oe_ins256) : S::sub(m11, oe_ins256);
       Vec val256 = temp256;
-      e11 = S::sub(e11, e_ins256);
+      e11 = SAT ? S::subs(e11, e_ins256) : S::sub(e11, e_ins256);
       if (CIGAR) {
         dcmp = S::gt(e11, val256);
         dtmp = S::blend(zero256, S::set(0x10), dcmp);
         d = S::or_(d, dtmp);
       }
       e11 = S::max(val256, e11);
-      temp256 = S::sub(m11, oe_del256);
+      temp256 = SAT ? S::subs(m11, oe_del256) : S::sub(m11, oe_del256);
       val256 = temp256;
-      f21 = S::sub(f11, e_del256);
+      f21 = SAT ? S::subs(f11, e_del256) : S::sub(f11, e_del256);
       if (CIGAR) {
         dcmp = S::gt(f21, val256);
         dtmp = S::blend(zero256, S::set(0x08), dcmp);
@@ -1175,6 +1235,8 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
       Cmp cmp2 = S::gt(head256, pj256);
       Cmp cmp1 = S::gt(pj256, tail256);
       cmp1 = S::orc_(cmp1, cmp2);
+      if (SAT && (j > beg || beg == 0)) // else h10 is the edge of the band
+        lo256 = S::min(lo256, S::blend(h10, zero256, cmp1));
       h10 = S::blend(h10, init256, cmp1);
       f21 = S::blend(f21, init256, cmp1);
 
@@ -1219,6 +1281,11 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
         gscore = max_gh;
       }
     }
+    if (SAT) {
+      Vec pj256 = S::set(j);
+      Cmp cmp1 = S::orc_(S::gt(pj256, tail256), S::gt(head256, pj256));
+      lo256 = S::min(lo256, S::blend(h10, zero256, cmp1));
+    }
     S::store((Vec *)(H_h + j * SIMD_WIDTH), h10);
     S::store((Vec *)(F + j * SIMD_WIDTH), init256);
 
@@ -1261,13 +1328,16 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
     Vec tmpi = S::sub(i1_256, x256);
     Vec tmpj = S::sub(y1_256, y256);
     cmp = S::gt(tmpi, tmpj);
-    score256 = S::sub(maxScore256, maxRS1);
+    score256 = SAT ? S::subs(maxScore256, maxRS1) : S::sub(maxScore256, maxRS1);
+    if (SAT)
+      hi256 = S::max(hi256, score256);
     Vec insdel = S::blend(e_ins256, e_del256, cmp);
     Vec sub_a256 = S::sub(tmpi, tmpj);
     Vec sub_b256 = S::sub(tmpj, tmpi);
     Vec tmp = S::blend(sub_b256, sub_a256, cmp);
-    tmp = S::sub(score256, tmp);
+    tmp = SAT ? S::subs(score256, tmp) : S::sub(score256, tmp);
     cmp = S::gt(tmp, zdrop256);
+    cmp = S::andc_(cmp, S::gt(tlen256, i256)); // rows past tlen are padding
     exit0 = S::blend(exit0, zero256, cmp);
     gscore = S::blend(gscore, neg_inf256, cmp);
 
@@ -1338,7 +1408,7 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
       tmpb = tmp;
     }
     index256 = S::add(index256, two256);
-    tail256 = S::min(index256, qlen256);
+    tail256 = S::umin(index256, qlen256); // index256 may exceed the 8-bit maximum
   }
 
   int_t score[SIMD_WIDTH] __attribute((aligned(64)));
@@ -1356,6 +1426,12 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
   int_t gscore_ar[SIMD_WIDTH] __attribute((aligned(64)));
   S::store((Vec *)gscore_ar, gscore);
 
+  int_t lo[SIMD_WIDTH] __attribute((aligned(64)));
+  S::store((Vec *)lo, lo256);
+
+  int_t hi[SIMD_WIDTH] __attribute((aligned(64)));
+  S::store((Vec *)hi, hi256);
+
   // int_t maxie_ar[SIMD_WIDTH] __attribute((aligned(64)));
   // S::store((Vec *)maxie_ar, max_ie256);
 
@@ -1364,6 +1440,10 @@ void InterSW<W, N, CIGAR>::SWCore(uint_t seq1SoA[], uint_t seq2SoA[], uint_t nro
       break;
     const bool ext_only = (p[i].flags & KSW_EZ_EXTZ_ONLY) != 0;
     p[i].score = ext_only ? score[i] : gscore_ar[i];
+    if (SAT && (hi[i] >= SAT_MAX || lo[i] <= NEG_INF)) {
+      p[i].flags |= SEQ_INTER_OVERFLOW;
+      continue;
+    }
     if (p[i].score == NEG_INF)
       p[i].score = KSW_NEG_INF;
 
@@ -0,0 +1,90 @@
+#include "kalloc.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+// blocks kept for reuse; a ksw2 call has at most four live at a time
+const size_t KM_MAX_FREE = 16;
+// bytes kept for reuse, so that one long alignment does not pin its matrices
+// to the thread for good
+const size_t KM_MAX_FREE_BYTES = (size_t)64 << 20;
+// keeps blocks 16-byte aligned, as malloc's are
+const size_t KM_HEADER = 16;
+
+struct Pool {
+  std::vector<void *> free; // block bases
+  size_t freeBytes = 0;      // total capacity of the free blocks
+};
+
+size_t &capacity(void *base) { return *(size_t *)base; }
+
+// sizes are rounded up so that blocks fit requests of slightly different sizes
+size_t roundUp(size_t size) {
+  size_t cap = 64;
+  while (cap < size)
+    cap <<= 1;
+  return cap;
+}
+} // namespace
+
+void *km_init() { return new Pool(); }
+
+void km_destroy(void *km) {
+  if (!km)
+    return;
+  auto *pool = (Pool *)km;
+  for (void *base : pool->free)
+    free(base);
+  delete pool;
+}
+
+void *km_malloc(void *km, size_t size) {
+  auto *pool = (Pool *)km;
+  auto best = pool->free.end();
+  for (auto it = pool->free.begin(); it != pool->free.end(); ++it) {
+    if (capacity(*it) >= size &&
+        (best == pool->free.end() || capacity(*it) < capacity(*best)))
+      best = it;
+  }
+
+  void *base;
+  if (best != pool->free.end()) {
+    base = *best;
+    pool->freeBytes -= capacity(base);
+    *best = pool->free.back();
+    pool->free.pop_back();
+  } else {
+    size_t cap = roundUp(size);
+    base = malloc(KM_HEADER + cap);
+    if (!base)
+      abort();
+    capacity(base) = cap;
+  }
+  return (char *)base + KM_HEADER;
+}
+
+void *km_calloc(void *km, size_t count, size_t size) {
+  void *p = km_malloc(km, count * size);
+  memset(p, 0, count * size);
+  return p;
+}
+
+void km_free(void *km, void *ptr) {
+  if (!ptr)
+    return;
+  auto *pool = (Pool *)km;
+  void *base = (char *)ptr - KM_HEADER;
+  pool->free.push_back(base);
+  pool->freeBytes += capacity(base);
+  while (pool->free.size() > KM_MAX_FREE || pool->freeBytes > KM_MAX_FREE_BYTES) {
+    auto largest = std::max_element(
+        pool->free.begin(), pool->free.end(),
+        [](void *a, void *b) { return capacity(a) < capacity(b); });
+    pool->freeBytes -= capacity(*largest);
+    free(*largest);
+    *largest = pool->free.back();
+    pool->free.pop_back();
+  }
+}
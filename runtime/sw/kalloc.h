@@ -0,0 +1,22 @@
+#ifndef KALLOC_H_
+#define KALLOC_H_
+
+#include <cstddef>
+
+/*
+ * Scratch memory pool for ksw2's DP matrices, in the role of minimap2's kalloc
+ * (https://github.com/lh3/minimap2/blob/master/kalloc.h). Freed blocks are kept
+ * and handed out again to later requests that fit, so that aligning many pairs
+ * of similar lengths allocates only for the first few. At most 16 blocks and
+ * 64 MiB are kept, releasing the largest blocks first. A pool must only be
+ * used by one thread at a time. Memory comes from malloc rather than the GC,
+ * so nothing in a pool may point to GC-allocated objects.
+ */
+
+void *km_init();
+void km_destroy(void *km);
+void *km_malloc(void *km, size_t size);
+void *km_calloc(void *km, size_t count, size_t size);
+void km_free(void *km, void *ptr);
+
+#endif // KALLOC_H_
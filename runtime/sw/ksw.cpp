@@ -0,0 +1,259 @@
+#include "ksw.h"
+#include "lib.h"
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>
+#include <vector>
+
+struct kswq_t {
+  int qlen;
+  int m;
+  int gapo;
+  int gape;
+  int shift;  // added to 8-bit profile scores to make them non-negative
+  int slen8;  // segment length with 16 lanes
+  int slen16; // segment length with 8 lanes
+  __m128i *qp8;
+  __m128i *qp16;
+  uint8_t *query; // for the scalar fallback
+  int8_t *mat;
+};
+
+namespace {
+const int KSW_OVERFLOW = -1;
+
+// H0, H1, E and Hmax of the calling thread
+__m128i *scratch(int slen) {
+  thread_local std::vector<uint8_t> buf;
+  const size_t size = 4 * (size_t)slen * sizeof(__m128i) + 15;
+  if (buf.size() < size)
+    buf.resize(size);
+  return (__m128i *)(((size_t)buf.data() + 15) >> 4 << 4); // 16-byte aligned
+}
+
+int hmaxU8(__m128i x) {
+  x = _mm_max_epu8(x, _mm_srli_si128(x, 8));
+  x = _mm_max_epu8(x, _mm_srli_si128(x, 4));
+  x = _mm_max_epu8(x, _mm_srli_si128(x, 2));
+  x = _mm_max_epu8(x, _mm_srli_si128(x, 1));
+  return _mm_extract_epi16(x, 0) & 0xff;
+}
+
+int hmaxI16(__m128i x) {
+  x = _mm_max_epi16(x, _mm_srli_si128(x, 8));
+  x = _mm_max_epi16(x, _mm_srli_si128(x, 4));
+  x = _mm_max_epi16(x, _mm_srli_si128(x, 2));
+  return (int16_t)_mm_extract_epi16(x, 0);
+}
+
+// lays the profile out so that vector j of residue a holds the scores of
+// query positions j, j + slen, j + 2*slen, ...; positions past the end of
+// the query get the lowest score in the matrix
+template <typename T>
+void fillProfile(T *t, int p, int slen, int qlen, const uint8_t *query, int m,
+                 const int8_t *mat, int minsc, int shift) {
+  for (int a = 0; a < m; a++) {
+    const int8_t *ma = mat + a * m;
+    for (int i = 0; i < slen; i++)
+      for (int k = i; k < slen * p; k += slen)
+        *t++ = (T)((k >= qlen ? minsc : ma[query[k]]) + shift);
+  }
+}
+
+// the query end is the first query position holding the best score in Hmax
+template <typename T>
+int queryEnd(const __m128i *Hmax, int p, int slen, int score) {
+  const T *t = (const T *)Hmax;
+  int qe = -1;
+  for (int i = 0; i < slen * p; i++) {
+    int pos = i / p + i % p * slen;
+    if ((int)t[i] == score && (qe < 0 || pos < qe))
+      qe = pos;
+  }
+  return qe;
+}
+
+kswr_t alignU8(const kswq_t *q, int tlen, const uint8_t *target) {
+  const int slen = q->slen8;
+  __m128i *H0 = scratch(slen), *H1 = H0 + slen, *E = H1 + slen, *Hmax = E + slen;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i gapoe = _mm_set1_epi8((char)(q->gapo + q->gape));
+  const __m128i gape = _mm_set1_epi8((char)q->gape);
+  const __m128i shift = _mm_set1_epi8((char)q->shift);
+  for (int j = 0; j < slen; j++)
+    H0[j] = E[j] = Hmax[j] = zero;
+
+  int gmax = 0, te = -1;
+  for (int i = 0; i < tlen; i++) {
+    const __m128i *S = q->qp8 + target[i] * slen;
+    __m128i f = zero, max = zero;
+    __m128i h = _mm_slli_si128(H0[slen - 1], 1); // H(i-1,-1) is 0
+    for (int j = 0; j < slen; j++) {
+      // H(i,j) = max{H(i-1,j-1) + S(i,j), E(i,j), F(i,j)}
+      h = _mm_subs_epu8(_mm_adds_epu8(h, S[j]), shift);
+      __m128i e = E[j];
+      h = _mm_max_epu8(h, e);
+      h = _mm_max_epu8(h, f);
+      max = _mm_max_epu8(max, h);
+      H1[j] = h;
+      // E(i+1,j) and F(i,j+1)
+      __m128i t = _mm_subs_epu8(h, gapoe);
+      E[j] = _mm_max_epu8(_mm_subs_epu8(e, gape), t);
+      f = _mm_max_epu8(_mm_subs_epu8(f, gape), t);
+      h = H0[j];
+    }
+    // carry F across lanes until it can no longer raise H; an H raised here
+    // stays below the row maximum, but E still has to see it
+    for (int k = 0; k < 16; k++) {
+      f = _mm_slli_si128(f, 1);
+      int j = 0;
+      for (; j < slen; j++) {
+        __m128i hold = H1[j];
+        h = _mm_max_epu8(hold, f);
+        H1[j] = h;
+        E[j] = _mm_max_epu8(E[j], _mm_subs_epu8(h, gapoe));
+        f = _mm_subs_epu8(f, gape);
+        __m128i t = _mm_subs_epu8(hold, gapoe);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(f, t), zero)) == 0xffff)
+          break;
+      }
+      if (j < slen)
+        break;
+    }
+
+    int imax = hmaxU8(max);
+    if (imax > gmax) {
+      gmax = imax;
+      te = i;
+      std::copy(H1, H1 + slen, Hmax);
+      if (gmax + q->shift >= 255)
+        return {KSW_OVERFLOW, -1, -1};
+    }
+    std::swap(H0, H1);
+  }
+  if (gmax == 0)
+    return {0, -1, -1};
+  return {gmax, te, queryEnd<uint8_t>(Hmax, 16, slen, gmax)};
+}
+
+kswr_t alignI16(const kswq_t *q, int tlen, const uint8_t *target) {
+  const int slen = q->slen16;
+  __m128i *H0 = scratch(slen), *H1 = H0 + slen, *E = H1 + slen, *Hmax = E + slen;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i gapoe = _mm_set1_epi16((short)(q->gapo + q->gape));
+  const __m128i gape = _mm_set1_epi16((short)q->gape);
+  for (int j = 0; j < slen; j++)
+    H0[j] = E[j] = Hmax[j] = zero;
+
+  int gmax = 0, te = -1;
+  for (int i = 0; i < tlen; i++) {
+    const __m128i *S = q->qp16 + target[i] * slen;
+    __m128i f = zero, max = zero;
+    __m128i h = _mm_slli_si128(H0[slen - 1], 2);
+    for (int j = 0; j < slen; j++) {
+      // E and F are never negative, so neither is H
+      h = _mm_adds_epi16(h, S[j]);
+      __m128i e = E[j];
+      h = _mm_max_epi16(h, e);
+      h = _mm_max_epi16(h, f);
+      max = _mm_max_epi16(max, h);
+      H1[j] = h;
+      __m128i t = _mm_subs_epu16(h, gapoe);
+      E[j] = _mm_max_epi16(_mm_subs_epu16(e, gape), t);
+      f = _mm_max_epi16(_mm_subs_epu16(f, gape), t);
+      h = H0[j];
+    }
+    for (int k = 0; k < 8; k++) {
+      f = _mm_slli_si128(f, 2);
+      int j = 0;
+      for (; j < slen; j++) {
+        __m128i hold = H1[j];
+        h = _mm_max_epi16(hold, f);
+        H1[j] = h;
+        E[j] = _mm_max_epi16(E[j], _mm_subs_epu16(h, gapoe));
+        f = _mm_subs_epu16(f, gape);
+        __m128i t = _mm_subs_epu16(hold, gapoe);
+        if (!_mm_movemask_epi8(_mm_cmpgt_epi16(f, t)))
+          break;
+      }
+      if (j < slen)
+        break;
+    }
+
+    int imax = hmaxI16(max);
+    if (imax > gmax) {
+      gmax = imax;
+      te = i;
+      std::copy(H1, H1 + slen, Hmax);
+      if (gmax >= INT16_MAX)
+        return {KSW_OVERFLOW, -1, -1};
+    }
+    std::swap(H0, H1);
+  }
+  if (gmax == 0)
+    return {0, -1, -1};
+  return {gmax, te, queryEnd<int16_t>(Hmax, 8, slen, gmax)};
+}
+
+kswr_t alignScalar(const kswq_t *q, int tlen, const uint8_t *target) {
+  const int qlen = q->qlen;
+  const int gapoe = q->gapo + q->gape;
+  std::vector<int> H(qlen, 0), E(qlen, 0);
+  int gmax = 0, te = -1, qe = -1;
+  for (int i = 0; i < tlen; i++) {
+    const int8_t *ma = q->mat + target[i] * q->m;
+    int diag = 0, f = 0, imax = 0, jmax = -1;
+    for (int j = 0; j < qlen; j++) {
+      int h = std::max({diag + ma[q->query[j]], E[j], f, 0});
+      diag = H[j];
+      H[j] = h;
+      if (h > imax)
+        imax = h, jmax = j;
+      E[j] = std::max(E[j] - q->gape, h - gapoe);
+      f = std::max(f - q->gape, h - gapoe);
+    }
+    if (imax > gmax)
+      gmax = imax, te = i, qe = jmax;
+  }
+  return {gmax, te, qe};
+}
+} // namespace
+
+kswq_t *ksw_qinit(int qlen, const uint8_t *query, int m, const int8_t *mat,
+                  int gapo, int gape) {
+  const int slen8 = std::max((qlen + 15) / 16, 1);
+  const int slen16 = std::max((qlen + 7) / 8, 1);
+  const size_t vecs = (size_t)(slen8 + slen16) * m;
+  auto *base = (char *)seq_alloc_atomic(sizeof(kswq_t) + 15 + vecs * sizeof(__m128i) +
+                                        qlen + m * m);
+  auto *q = (kswq_t *)base;
+  q->qp8 = (__m128i *)(((size_t)(base + sizeof(kswq_t)) + 15) >> 4 << 4);
+  q->qp16 = q->qp8 + (size_t)slen8 * m;
+  q->query = (uint8_t *)(q->qp16 + (size_t)slen16 * m);
+  q->mat = (int8_t *)(q->query + qlen);
+  q->qlen = qlen;
+  q->m = m;
+  q->gapo = gapo;
+  q->gape = gape;
+  q->slen8 = slen8;
+  q->slen16 = slen16;
+  memcpy(q->query, query, qlen);
+  memcpy(q->mat, mat, m * m);
+
+  const int minsc = std::min(0, (int)*std::min_element(mat, mat + m * m));
+  q->shift = -minsc;
+  fillProfile((uint8_t *)q->qp8, 16, slen8, qlen, query, m, mat, minsc, q->shift);
+  fillProfile((int16_t *)q->qp16, 8, slen16, qlen, query, m, mat, minsc, 0);
+  return q;
+}
+
+kswr_t ksw_qalign(const kswq_t *q, int tlen, const uint8_t *target) {
+  if (q->qlen == 0 || tlen == 0)
+    return {0, -1, -1};
+  kswr_t r = alignU8(q, tlen, target);
+  if (r.score == KSW_OVERFLOW)
+    r = alignI16(q, tlen, target);
+  if (r.score == KSW_OVERFLOW)
+    r = alignScalar(q, tlen, target);
+  return r;
+}
@@ -0,0 +1,31 @@
+#ifndef KSW_H_
+#define KSW_H_
+
+#include <cstdint>
+
+/*
+ * Striped Smith-Waterman (Farrar 2007) against a precomputed query profile,
+ * adapted from BWA's ksw.c (https://github.com/lh3/bwa/blob/master/ksw.c).
+ *
+ * A profile holds the query's substitution scores laid out in the striped
+ * order for both 8- and 16-bit lanes, so aligning it against a target needs
+ * no per-call setup. Each alignment runs the 8-bit kernel first and falls back
+ * to the 16-bit one, then to a scalar one, if the score overflows. Profiles
+ * are read-only once built and can be shared between threads.
+ */
+
+struct kswq_t;
+
+struct kswr_t {
+  int score; // best local alignment score
+  int te;    // target end (inclusive), or -1 if score is 0
+  int qe;    // query end (inclusive), or -1 if score is 0
+};
+
+// query holds qlen residues in [0, m); mat is m x m; the profile is
+// allocated with seq_alloc_atomic
+kswq_t *ksw_qinit(int qlen, const uint8_t *query, int m, const int8_t *mat,
+                  int gapo, int gape);
+kswr_t ksw_qalign(const kswq_t *q, int tlen, const uint8_t *target);
+
+#endif // KSW_H_
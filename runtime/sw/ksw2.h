@@ -1,6 +1,7 @@
 #ifndef KSW2_H_
 #define KSW2_H_
 
+#include "kalloc.h"
 #include <cstddef>
 #include <cstdint>
 
@@ -115,18 +116,22 @@ extern "C" void *seq_alloc_atomic(size_t n);
 extern "C" void *seq_calloc_atomic(size_t m, size_t n);
 extern "C" void *seq_realloc(void *p, size_t n);
 extern "C" void seq_free(void *p);
-#define kmalloc(km, size) seq_alloc_atomic((size))
-#define kcalloc(km, count, size) seq_calloc_atomic((count), (size))
-#define krealloc(km, ptr, size) seq_realloc((ptr), (size))
-#define kfree(km, ptr) seq_free((ptr))
+// DP matrices come from the pool if one is given; CIGARs are returned to Seq
+// code, so they always come from the GC
+#define kmalloc(km, size) ((km) ? km_malloc((km), (size)) : seq_alloc_atomic((size)))
+#define kcalloc(km, count, size)                                                       \
+  ((km) ? km_calloc((km), (count), (size)) : seq_calloc_atomic((count), (size)))
+#define kfree(km, ptr) ((km) ? km_free((km), (ptr)) : seq_free((ptr)))
+#define kcigar_malloc(size) seq_alloc_atomic((size))
+#define kcigar_realloc(ptr, size) seq_realloc((ptr), (size))
 
 static inline uint32_t *ksw_push_cigar(void *km, int *n_cigar, int *m_cigar,
                                        uint32_t *cigar, uint32_t op, int len) {
   if (*n_cigar == 0 || op != (cigar[(*n_cigar) - 1] & 0xf)) {
     if (*n_cigar == *m_cigar) {
       *m_cigar = *m_cigar ? (*m_cigar) << 1 : 4;
-      cigar = (uint32_t *)((*n_cigar) ? krealloc(km, cigar, (*m_cigar) << 2)
-                                      : kmalloc(km, (*m_cigar) << 2));
+      cigar = (uint32_t *)((*n_cigar) ? kcigar_realloc(cigar, (*m_cigar) << 2)
+                                      : kcigar_malloc((*m_cigar) << 2));
     }
     cigar[(*n_cigar)++] = len << 4 | op;
   } else
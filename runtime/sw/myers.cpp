@@ -0,0 +1,198 @@
+#include "myers.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEQ_MYERS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+typedef uint64_t Word;
+const int WORD_SIZE = 64;
+const Word HIGH_BIT = (Word)1 << (WORD_SIZE - 1);
+
+// peq[c * words + b] has bit i set if p[WORD_SIZE * b + i] is symbol c
+void buildPeq(const uint8_t *p, int m, const uint8_t *map, int words, Word *peq) {
+  std::fill(peq, peq + MYERS_SIGMA * words, 0);
+  for (int i = 0; i < m; i++)
+    peq[map[p[i]] * words + i / WORD_SIZE] |= (Word)1 << (i % WORD_SIZE);
+}
+
+// advances one block of the pattern by a text column, given the horizontal
+// delta hin entering it from above; returns the delta leaving it at outBit
+inline int advanceBlock(Word &Pv, Word &Mv, Word Eq, int hin, Word outBit) {
+  const Word Xv = Eq | Mv;
+  if (hin < 0)
+    Eq |= 1;
+  const Word Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+  Word Ph = Mv | ~(Xh | Pv);
+  Word Mh = Pv & Xh;
+  const int hout = (Ph & outBit) ? 1 : (Mh & outBit) ? -1 : 0;
+  Ph <<= 1;
+  Mh <<= 1;
+  if (hin < 0)
+    Mh |= 1;
+  else if (hin > 0)
+    Ph |= 1;
+  Pv = Mh | ~(Xv | Ph);
+  Mv = Ph & Xv;
+  return hout;
+}
+
+// the last column of text can lower the last row's score by at most one
+inline bool exceeds(int score, int remaining, int k) {
+  return k >= 0 && score - remaining > k;
+}
+
+int distWord(const Word *peq, int m, const uint8_t *t, int n, const uint8_t *map,
+             int k) {
+  const Word hb = (Word)1 << (m - 1);
+  Word Pv = ~(Word)0, Mv = 0;
+  int score = m;
+  for (int j = 0; j < n; j++) {
+    score += advanceBlock(Pv, Mv, peq[map[t[j]]], 1, hb);
+    if (exceeds(score, n - 1 - j, k))
+      return -1;
+  }
+  return score;
+}
+
+int distBlocks(const Word *peq, int m, int words, const uint8_t *t, int n,
+               const uint8_t *map, int k) {
+  thread_local std::vector<Word> Pv, Mv;
+  thread_local std::vector<int> score; // of each block's last row
+  Pv.resize(words);
+  Mv.resize(words);
+  score.resize(words);
+
+  // a block is first needed once its top row is in the band; until then its
+  // cells exceed k, and it starts from the upper bound of a vertical gap below
+  // the block above, which keeps every cell within k exact
+  auto activate = [&](int b) {
+    Pv[b] = ~(Word)0;
+    Mv[b] = 0;
+    score[b] = (b ? score[b - 1] : 0) + std::min(WORD_SIZE, m - WORD_SIZE * b);
+  };
+  int last = k < 0 ? words - 1 : std::min(words - 1, k / WORD_SIZE);
+  for (int b = 0; b <= last; b++)
+    activate(b);
+
+  const Word lastBit = (Word)1 << ((m - 1) % WORD_SIZE);
+  for (int j = 0; j < n; j++) {
+    while (last + 1 < words && WORD_SIZE * (last + 1) + 1 <= j + 1 + k)
+      activate(++last);
+    const Word *eq = peq + map[t[j]] * words;
+    int hin = 1;
+    for (int b = 0; b <= last; b++) {
+      hin = advanceBlock(Pv[b], Mv[b], eq[b], hin, b == words - 1 ? lastBit : HIGH_BIT);
+      score[b] += hin;
+    }
+    if (last == words - 1 && exceeds(score[last], n - 1 - j, k))
+      return -1;
+  }
+  return last == words - 1 ? score[last] : -1;
+}
+
+int finish(int d, int k) { return (k >= 0 && d > k) ? -1 : d; }
+
+#ifdef SEQ_MYERS_X86
+// four targets at a time, one per 64-bit lane
+__attribute__((target("avx2"))) void distFourAVX2(const Word *peq, int m,
+                                                  const uint8_t *const *ts,
+                                                  const int *ns, const uint8_t *map,
+                                                  int k, int *out) {
+  const __m256i ones = _mm256_set1_epi64x(-1);
+  const __m256i one = _mm256_set1_epi64x(1);
+  const __m128i hbShift = _mm_cvtsi32_si128(m - 1);
+  const __m256i len = _mm256_set_epi64x(ns[3], ns[2], ns[1], ns[0]);
+  const int nmax = std::max({ns[0], ns[1], ns[2], ns[3]});
+  __m256i Pv = ones, Mv = _mm256_setzero_si256(), score = _mm256_set1_epi64x(m);
+  alignas(32) int64_t s[4];
+  for (int j = 0; j < nmax; j++) {
+    alignas(32) Word e[4];
+    for (int l = 0; l < 4; l++)
+      e[l] = j < ns[l] ? peq[map[ts[l][j]]] : 0;
+    const __m256i Eq = _mm256_load_si256((const __m256i *)e);
+    const __m256i Xv = _mm256_or_si256(Eq, Mv);
+    const __m256i Xh = _mm256_or_si256(
+        _mm256_xor_si256(_mm256_add_epi64(_mm256_and_si256(Eq, Pv), Pv), Pv), Eq);
+    __m256i Ph = _mm256_or_si256(Mv, _mm256_andnot_si256(_mm256_or_si256(Xh, Pv), ones));
+    __m256i Mh = _mm256_and_si256(Pv, Xh);
+    const __m256i d =
+        _mm256_sub_epi64(_mm256_and_si256(_mm256_srl_epi64(Ph, hbShift), one),
+                         _mm256_and_si256(_mm256_srl_epi64(Mh, hbShift), one));
+    const __m256i active = _mm256_cmpgt_epi64(len, _mm256_set1_epi64x(j));
+    score = _mm256_add_epi64(score, _mm256_and_si256(d, active));
+    Ph = _mm256_or_si256(_mm256_slli_epi64(Ph, 1), one);
+    Mh = _mm256_slli_epi64(Mh, 1);
+    Pv = _mm256_or_si256(Mh, _mm256_andnot_si256(_mm256_or_si256(Xv, Ph), ones));
+    Mv = _mm256_and_si256(Ph, Xv);
+
+    if (k >= 0 && (j & 7) == 7) {
+      _mm256_store_si256((__m256i *)s, score);
+      int over = 0;
+      for (int l = 0; l < 4; l++)
+        over += exceeds((int)s[l], std::max(ns[l] - 1 - j, 0), k);
+      if (over == 4) {
+        for (int l = 0; l < 4; l++)
+          out[l] = -1;
+        return;
+      }
+    }
+  }
+  _mm256_store_si256((__m256i *)s, score);
+  for (int l = 0; l < 4; l++)
+    out[l] = finish((int)s[l], k);
+}
+#endif
+} // namespace
+
+int myers_dist(const uint8_t *p, int m, const uint8_t *t, int n, const uint8_t *map,
+               int k) {
+  if (m > n) {
+    std::swap(p, t);
+    std::swap(m, n);
+  }
+  if (k >= 0 && n - m > k)
+    return -1;
+  if (m == 0)
+    return n;
+
+  const int words = (m + WORD_SIZE - 1) / WORD_SIZE;
+  if (words == 1) {
+    Word peq[MYERS_SIGMA];
+    buildPeq(p, m, map, 1, peq);
+    return finish(distWord(peq, m, t, n, map, k), k);
+  }
+  thread_local std::vector<Word> peq;
+  peq.resize(MYERS_SIGMA * words);
+  buildPeq(p, m, map, words, peq.data());
+  return finish(distBlocks(peq.data(), m, words, t, n, map, k), k);
+}
+
+void myers_dist_many(const uint8_t *p, int m, const uint8_t *const *ts, const int *ns,
+                     int count, const uint8_t *map, int k, int *out) {
+  int i = 0;
+  if (m > 0 && m <= WORD_SIZE) {
+    Word peq[MYERS_SIGMA];
+    buildPeq(p, m, map, 1, peq);
+#ifdef SEQ_MYERS_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+      for (; i + 4 <= count; i += 4)
+        distFourAVX2(peq, m, ts + i, ns + i, map, k, out + i);
+    }
+#endif
+    for (; i < count; i++) {
+      if (k >= 0 && std::abs(ns[i] - m) > k)
+        out[i] = -1;
+      else
+        out[i] = finish(distWord(peq, m, ts[i], ns[i], map, k), k);
+    }
+    return;
+  }
+  for (; i < count; i++)
+    out[i] = myers_dist(p, m, ts[i], ns[i], map, k);
+}
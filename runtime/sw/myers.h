@@ -0,0 +1,29 @@
+#ifndef MYERS_H_
+#define MYERS_H_
+
+#include <cstdint>
+
+/*
+ * Bit-parallel edit (Levenshtein) distance (Myers 1999), with the blocked
+ * form of Hyyrö (2003) for patterns longer than 64, in the style of edlib
+ * (https://github.com/Martinsos/edlib).
+ *
+ * Sequences are bytes that map maps to symbols in [0, MYERS_SIGMA). Given a
+ * limit k >= 0, the search stops as soon as the distance must exceed k, in
+ * which case -1 is returned; k < 0 means no limit. With more than one word
+ * of pattern, blocks entirely below the band i - j <= k are not started
+ * until the band reaches them; blocks above it are always computed, and
+ * single-word patterns are not banded.
+ */
+
+const int MYERS_SIGMA = 5;
+
+int myers_dist(const uint8_t *p, int m, const uint8_t *t, int n, const uint8_t *map,
+               int k);
+
+// distances from p to each of ts[0..count); one-vs-many runs several targets
+// in parallel SIMD lanes when p fits a single word
+void myers_dist_many(const uint8_t *p, int m, const uint8_t *const *ts, const int *ns,
+                     int count, const uint8_t *map, int k, int *out);
+
+#endif // MYERS_H_
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "lib.h"
+
+/*
+ * Write-behind output
+ *
+ * Writes are appended to large buffers that are written out on a background
+ * thread, so that formatting output overlaps with writing it. A single thread
+ * writes the buffers of every open file, in the order they were filled.
+ * Compressed output is written as BGZF, which is compressed block-parallel on
+ * one HTSlib thread pool shared by all files, and can be read by any gzip
+ * reader.
+ *
+ * Each writer has its own lock, so that a file can be written from several
+ * threads at once, as by @par loops or ||> stages; every write is appended
+ * as a whole. Writers that are still open when the program exits are drained
+ * and closed by an atexit handler, so output is not lost if close() is never
+ * called.
+ */
+
+struct BGZF;
+struct hts_tpool;
+extern "C" {
+BGZF *bgzf_open(const char *path, const char *mode);
+int bgzf_thread_pool(BGZF *fp, hts_tpool *pool, int qsize);
+ssize_t bgzf_write(BGZF *fp, const void *data, size_t length);
+int bgzf_flush(BGZF *fp);
+int bgzf_close(BGZF *fp);
+hts_tpool *hts_tpool_init(int n);
+void hts_tpool_destroy(hts_tpool *p);
+}
+
+namespace {
+const size_t WRITE_BUFFER_SIZE = 1 << 22;
+const size_t WRITE_BUFFERS = 4;
+const unsigned MAX_COMPRESSION_THREADS = 4;
+
+class WriteBehind;
+
+struct Chunk {
+  WriteBehind *writer;
+  size_t index;
+  size_t len;
+};
+
+// state shared by all writers; one mutex guards the queue and every writer's
+// buffer bookkeeping, which is only touched once per buffer
+struct Shared {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Chunk> queued;
+  std::unordered_set<WriteBehind *> live;
+  std::thread worker;
+  hts_tpool *pool;
+  int poolSize;
+  bool stop;
+
+  Shared()
+      : mutex(), cv(), queued(), live(), worker(), pool(nullptr), poolSize(0),
+        stop(false) {}
+
+  void run();
+};
+
+Shared &shared();
+
+class WriteBehind {
+private:
+  friend struct Shared;
+
+  // exactly one of these is set until the writer is closed; the FILE is
+  // owned by the caller
+  FILE *file;
+  BGZF *bgzf;
+  // serializes the writer's callers; taken before the shared mutex
+  std::mutex mutex;
+  std::vector<std::unique_ptr<char[]>> buffers;
+  std::deque<size_t> idle;
+  // chunks queued or being written
+  size_t pending;
+  bool failed;
+
+  // the buffer being filled
+  size_t current;
+  size_t len;
+  seq_int_t pos;
+
+  bool sink(const char *data, size_t n) {
+    if (file)
+      return fwrite(data, 1, n, file) == n;
+    return bgzf && bgzf_write(bgzf, data, n) == (ssize_t)n;
+  }
+
+  void submit() {
+    if (len == 0)
+      return;
+    auto &s = shared();
+    {
+      std::unique_lock<std::mutex> lock(s.mutex);
+      s.queued.push_back({this, current, len});
+      pending++;
+      s.cv.notify_all();
+      s.cv.wait(lock, [this] { return !idle.empty(); });
+      current = idle.front();
+      idle.pop_front();
+    }
+    len = 0;
+  }
+
+  bool drain() {
+    submit();
+    auto &s = shared();
+    std::unique_lock<std::mutex> lock(s.mutex);
+    s.cv.wait(lock, [this] { return pending == 0; });
+    return !failed;
+  }
+
+  bool hasFailed() {
+    std::lock_guard<std::mutex> lock(shared().mutex);
+    return failed;
+  }
+
+public:
+  WriteBehind(FILE *file, BGZF *bgzf)
+      : file(file), bgzf(bgzf), mutex(), buffers(), idle(), pending(0), failed(false),
+        current(0), len(0), pos(0) {
+    for (size_t i = 0; i < WRITE_BUFFERS; i++) {
+      buffers.emplace_back(new char[WRITE_BUFFER_SIZE]);
+      if (i)
+        idle.push_back(i);
+    }
+  }
+
+  bool write(const char *data, size_t n) {
+    std::lock_guard<std::mutex> guard(mutex);
+    pos += n;
+    bool submitted = false;
+    while (n > 0) {
+      if (len == WRITE_BUFFER_SIZE) {
+        submit();
+        submitted = true;
+      }
+      auto k = std::min(n, WRITE_BUFFER_SIZE - len);
+      memcpy(buffers[current].get() + len, data, k);
+      len += k;
+      data += k;
+      n -= k;
+    }
+    return !submitted || !hasFailed();
+  }
+
+  bool flush() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!drain())
+      return false;
+    return file ? fflush(file) == 0 : bgzf_flush(bgzf) == 0;
+  }
+
+  seq_int_t tell() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return pos;
+  }
+
+  bool close() {
+    std::lock_guard<std::mutex> guard(mutex);
+    bool ok = drain();
+    if (file) {
+      ok = (fflush(file) == 0) && ok;
+      file = nullptr;
+    }
+    if (bgzf) {
+      ok = (bgzf_close(bgzf) == 0) && ok;
+      bgzf = nullptr;
+    }
+    return ok;
+  }
+};
+
+void Shared::run() {
+  while (true) {
+    Chunk chunk;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this] { return stop || !queued.empty(); });
+      if (queued.empty())
+        return;
+      chunk = queued.front();
+      queued.pop_front();
+    }
+
+    auto *w = chunk.writer;
+    bool ok = w->sink(w->buffers[chunk.index].get(), chunk.len);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!ok)
+        w->failed = true;
+      w->idle.push_back(chunk.index);
+      w->pending--;
+    }
+    cv.notify_all();
+  }
+}
+
+void closeAll() {
+  auto &s = shared();
+  std::vector<WriteBehind *> writers;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    writers.assign(s.live.begin(), s.live.end());
+  }
+  // the writers stay open to the program, which frees them on close(); later
+  // writes to them fail
+  for (auto *w : writers)
+    w->close();
+}
+
+void closeAtExit() {
+  auto &s = shared();
+  closeAll();
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.stop = true;
+  }
+  s.cv.notify_all();
+  if (s.worker.joinable())
+    s.worker.join();
+  if (s.pool)
+    hts_tpool_destroy(s.pool);
+  s.pool = nullptr;
+}
+
+Shared &shared() {
+  static Shared s;
+  static std::once_flag started;
+  // registered after s is constructed, so it runs before s is destroyed
+  std::call_once(started, [] {
+    s.worker = std::thread([] { s.run(); });
+    std::atexit(closeAtExit);
+  });
+  return s;
+}
+
+WriteBehind *track(WriteBehind *w) {
+  auto &s = shared();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.live.insert(w);
+  return w;
+}
+
+hts_tpool *compressionPool() {
+  auto &s = shared();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (!s.pool) {
+    s.poolSize = (int)std::min(MAX_COMPRESSION_THREADS,
+                               std::max(1u, std::thread::hardware_concurrency()));
+    if (s.poolSize > 1)
+      s.pool = hts_tpool_init(s.poolSize);
+  }
+  return s.pool;
+}
+} // namespace
+
+SEQ_FUNC void *seq_writer_open_file(FILE *fp) {
+  return track(new WriteBehind(fp, nullptr));
+}
+
+SEQ_FUNC void *seq_writer_open_bgzf(const char *path, const char *mode) {
+  BGZF *fp = bgzf_open(path, mode);
+  if (!fp)
+    return nullptr;
+  if (auto *pool = compressionPool())
+    bgzf_thread_pool(fp, pool, 2 * shared().poolSize);
+  return track(new WriteBehind(nullptr, fp));
+}
+
+SEQ_FUNC bool seq_writer_write(void *w, const char *buf, seq_int_t n) {
+  return ((WriteBehind *)w)->write(buf, (size_t)n);
+}
+
+SEQ_FUNC bool seq_writer_write_int(void *w, seq_int_t n) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%" PRId64, (int64_t)n);
+  return ((WriteBehind *)w)->write(buf, (size_t)len);
+}
+
+SEQ_FUNC bool seq_writer_flush(void *w) { return ((WriteBehind *)w)->flush(); }
+
+SEQ_FUNC seq_int_t seq_writer_tell(void *w) { return ((WriteBehind *)w)->tell(); }
+
+SEQ_FUNC void seq_writer_close_all() { closeAll(); }
+
+SEQ_FUNC bool seq_writer_close(void *w) {
+  auto *writer = (WriteBehind *)w;
+  {
+    auto &s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.live.erase(writer);
+  }
+  bool ok = writer->close();
+  delete writer;
+  return ok;
+}
@@ -264,6 +264,56 @@ TEST_P(SeqTest, Run) {
     EXPECT_EQ(results.size(), expects.first.size());
   }
 }
+TEST(SeqCompileTest, ThinLTOExecutableRemovesPartitionObjects) {
+  char dir[] = "/tmp/seqtest.XXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  const string out = string(dir) + "/helloworld";
+
+  pid_t pid = fork();
+  GC_atfork_prepare();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    GC_atfork_child();
+    auto file = string(TEST_DIR) + "/core/helloworld.seq";
+    auto *module = parse(argv0, file, "", false, /* isTest */ 1, 0);
+    if (!module)
+      exit(EXIT_FAILURE);
+
+    // a cache directory enables per-source-file partitions even at one job
+    ir::LLVMVisitor visitor(/*debug=*/false);
+    visitor.setJobs(1);
+    visitor.setCacheDir(string(dir) + "/cache");
+    visitor.visit(module);
+    visitor.compile(out, {});
+    exit(EXIT_SUCCESS);
+  }
+  GC_atfork_parent();
+  int status = -1;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+
+  // whether or not linking succeeded, no partition objects may be left behind
+  const string prefix = "helloworld.";
+  vector<string> leftover;
+  DIR *d = opendir(dir);
+  ASSERT_NE(d, nullptr);
+  while (auto *entry = readdir(d)) {
+    string name = entry->d_name;
+    bool isPartition = name.size() > prefix.size() + 2 &&
+                       name.compare(0, prefix.size(), prefix) == 0 &&
+                       name.compare(name.size() - 2, 2, ".o") == 0;
+    if (isPartition)
+      leftover.push_back(name);
+  }
+  closedir(d);
+  EXPECT_TRUE(leftover.empty()) << leftover.size() << " objects left, e.g. "
+                                << (leftover.empty() ? "" : leftover[0]);
+
+  // clean up the executable and cache
+  auto command = "rm -rf '" + string(dir) + "'";
+  EXPECT_EQ(system(command.c_str()), 0);
+}
+
 auto getTypeTests(const vector<string> &files) {
   vector<tuple<string, bool, string, string, int, bool>> cases;
   for (auto &f : files) {
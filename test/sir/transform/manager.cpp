@@ -1,5 +1,10 @@
 #include "test.h"
 
+#include <mutex>
+#include <vector>
+
+#include "sir/analyze/dataflow/cfg.h"
+#include "sir/analyze/dataflow/reaching.h"
 #include "sir/transform/manager.h"
 #include "sir/transform/pass.h"
 
@@ -80,3 +85,95 @@ TEST_F(SIRCoreTest, PassManagerInvalidations) {
   ASSERT_EQ(2, DummyAnalysis::runCounter);
   ASSERT_EQ(3, DummyPass::runCounter);
 }
+
+class DummyFuncPass : public transform::Pass {
+private:
+  std::mutex &mutex;
+  std::vector<seq::ir::id_t> &visited;
+
+public:
+  DummyFuncPass(std::mutex &mutex, std::vector<seq::ir::id_t> &visited)
+      : mutex(mutex), visited(visited) {}
+
+  std::string getKey() const override { return PASS_KEY; }
+
+  std::unique_ptr<transform::Pass> clone() const override {
+    return std::make_unique<DummyFuncPass>(mutex, visited);
+  }
+
+  void run(Module *) override { FAIL() << "pass should run on functions"; }
+
+  void runOnFunc(BodiedFunc *func) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    visited.push_back(func->getId());
+  }
+};
+
+TEST_F(SIRCoreTest, PassManagerFunctionPasses) {
+  std::vector<seq::ir::id_t> expected = {module->getMainFunc()->getId()};
+  for (int i = 0; i < 100; i++)
+    expected.push_back(module->Nr<BodiedFunc>("f" + std::to_string(i))->getId());
+
+  std::mutex mutex;
+  std::vector<seq::ir::id_t> visited;
+  auto manager =
+      std::make_unique<transform::PassManager>(transform::PassManager::Init::EMPTY);
+  manager->setThreads(4);
+  manager->registerPass(std::make_unique<DummyFuncPass>(mutex, visited));
+  manager->run(module.get());
+
+  std::sort(expected.begin(), expected.end());
+  std::sort(visited.begin(), visited.end());
+  ASSERT_EQ(expected, visited);
+}
+
+class ModifyFuncPass : public transform::Pass {
+private:
+  BodiedFunc *func;
+  BodiedFunc *other;
+  std::string rdKey;
+  std::vector<std::pair<const void *, const void *>> &graphs;
+
+public:
+  ModifyFuncPass(BodiedFunc *func, BodiedFunc *other, std::string rdKey,
+                 std::vector<std::pair<const void *, const void *>> &graphs)
+      : func(func), other(other), rdKey(std::move(rdKey)), graphs(graphs) {}
+
+  std::string getKey() const override { return PASS_KEY; }
+
+  void run(Module *m) override {
+    auto *rd = getAnalysisResult<analyze::dataflow::RDResult>(rdKey);
+    ASSERT_TRUE(rd);
+    for (auto *f : {func, other}) {
+      ASSERT_EQ(rd->cfgResult->graphs.at(f->getId()).get(),
+                rd->results.at(f->getId())->getGraph());
+    }
+    graphs.emplace_back(rd->cfgResult->graphs.at(func->getId()).get(),
+                        rd->cfgResult->graphs.at(other->getId()).get());
+    cast<SeriesFlow>(func->getBody())->push_back(m->getInt(1));
+  }
+};
+
+TEST_F(SIRCoreTest, PassManagerIncrementalAnalyses) {
+  auto *f = module->Nr<BodiedFunc>("f");
+  f->setBody(module->Nr<SeriesFlow>());
+  auto *g = module->Nr<BodiedFunc>("g");
+  g->setBody(module->Nr<SeriesFlow>());
+
+  std::vector<std::pair<const void *, const void *>> graphs;
+  auto manager =
+      std::make_unique<transform::PassManager>(transform::PassManager::Init::EMPTY);
+  auto cfgKey =
+      manager->registerAnalysis(std::make_unique<analyze::dataflow::CFAnalysis>());
+  auto rdKey = manager->registerAnalysis(
+      std::make_unique<analyze::dataflow::RDAnalysis>(cfgKey), {cfgKey});
+  for (int i = 0; i < 2; i++)
+    manager->registerPass(std::make_unique<ModifyFuncPass>(f, g, rdKey, graphs), "",
+                          {rdKey}, {cfgKey});
+  manager->run(module.get());
+
+  // only the modified function's graph is rebuilt
+  ASSERT_EQ(2, graphs.size());
+  ASSERT_NE(graphs[0].first, graphs[1].first);
+  ASSERT_EQ(graphs[0].second, graphs[1].second);
+}
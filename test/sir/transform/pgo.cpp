@@ -0,0 +1,127 @@
+#include "test.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "sir/analyze/module/profile.h"
+#include "sir/transform/manager.h"
+#include "sir/transform/pgo/inlining.h"
+
+using namespace seq::ir;
+
+class HotFuncsAnalysis : public analyze::Analysis {
+private:
+  std::unordered_set<seq::ir::id_t> hot;
+
+public:
+  explicit HotFuncsAnalysis(std::unordered_set<seq::ir::id_t> hot)
+      : hot(std::move(hot)) {}
+
+  std::string getKey() const override { return analyze::module::ProfileAnalysis::KEY; }
+
+  std::unique_ptr<analyze::Result> run(const Module *) override {
+    std::unordered_map<seq::ir::id_t, uint64_t> counts;
+    for (auto id : hot)
+      counts.emplace(id, 100);
+    return std::make_unique<analyze::module::ProfileResult>(std::move(counts), 10);
+  }
+};
+
+TEST_F(SIRCoreTest, ProfileGuidedInliningInlinesEarlyReturns) {
+  auto *fnType = module->unsafeGetFuncType("**test_type**", module->getIntType(), {});
+  auto *callee = module->Nr<BodiedFunc>("callee");
+  callee->realize(cast<types::FuncType>(fnType), {});
+  // the early return can only be inlined aggressively
+  auto *early = module->Nr<SeriesFlow>();
+  early->push_back(module->Nr<ReturnInstr>(module->getInt(1)));
+  auto *calleeBody = module->Nr<SeriesFlow>();
+  calleeBody->push_back(module->Nr<IfFlow>(module->getBool(true), early));
+  calleeBody->push_back(module->Nr<ReturnInstr>(module->getInt(2)));
+  callee->setBody(calleeBody);
+
+  auto *caller = cast<BodiedFunc>(module->getMainFunc());
+  auto *callerBody = module->Nr<SeriesFlow>();
+  callerBody->push_back(module->Nr<CallInstr>(module->Nr<VarValue>(callee)));
+  caller->setBody(callerBody);
+
+  auto manager =
+      std::make_unique<transform::PassManager>(transform::PassManager::Init::EMPTY);
+  auto profileKey = manager->registerAnalysis(std::make_unique<HotFuncsAnalysis>(
+      std::unordered_set<seq::ir::id_t>{caller->getId(), callee->getId()}));
+  auto pass = std::make_unique<transform::pgo::ProfileGuidedInlining>(profileKey);
+  auto *inlining = pass.get();
+  manager->registerPass(std::move(pass), "", {profileKey});
+  manager->run(module.get());
+
+  ASSERT_EQ(1, inlining->getNumInlined());
+  ASSERT_FALSE(isA<CallInstr>(callerBody->front()));
+  ASSERT_TRUE(isA<FlowInstr>(callerBody->front()));
+}
+
+TEST_F(SIRCoreTest, ProfileGuidedInliningSkipsRecursiveCallees) {
+  auto *fnType = module->unsafeGetFuncType("**test_type**", module->getIntType(), {});
+  // f calls g, which calls f back
+  auto *f = module->Nr<BodiedFunc>("f");
+  auto *g = module->Nr<BodiedFunc>("g");
+  f->realize(cast<types::FuncType>(fnType), {});
+  g->realize(cast<types::FuncType>(fnType), {});
+  auto *fBody = module->Nr<SeriesFlow>();
+  fBody->push_back(
+      module->Nr<ReturnInstr>(module->Nr<CallInstr>(module->Nr<VarValue>(g))));
+  f->setBody(fBody);
+  auto *gBody = module->Nr<SeriesFlow>();
+  gBody->push_back(
+      module->Nr<ReturnInstr>(module->Nr<CallInstr>(module->Nr<VarValue>(f))));
+  g->setBody(gBody);
+
+  auto *caller = cast<BodiedFunc>(module->getMainFunc());
+  auto *callerBody = module->Nr<SeriesFlow>();
+  callerBody->push_back(module->Nr<CallInstr>(module->Nr<VarValue>(f)));
+  caller->setBody(callerBody);
+
+  auto manager =
+      std::make_unique<transform::PassManager>(transform::PassManager::Init::EMPTY);
+  auto profileKey = manager->registerAnalysis(std::make_unique<HotFuncsAnalysis>(
+      std::unordered_set<seq::ir::id_t>{caller->getId(), f->getId(), g->getId()}));
+  auto pass = std::make_unique<transform::pgo::ProfileGuidedInlining>(profileKey);
+  auto *inlining = pass.get();
+  manager->registerPass(std::move(pass), "", {profileKey});
+  manager->run(module.get());
+
+  ASSERT_EQ(0, inlining->getNumInlined());
+  ASSERT_TRUE(isA<CallInstr>(callerBody->front()));
+}
+
+TEST_F(SIRCoreTest, ProfileGuidedInliningInlinesOneLevelPerRun) {
+  auto *fnType = module->unsafeGetFuncType("**test_type**", module->getIntType(), {});
+  // main calls f, which calls g
+  auto *f = module->Nr<BodiedFunc>("f");
+  auto *g = module->Nr<BodiedFunc>("g");
+  f->realize(cast<types::FuncType>(fnType), {});
+  g->realize(cast<types::FuncType>(fnType), {});
+  auto *gBody = module->Nr<SeriesFlow>();
+  gBody->push_back(module->Nr<ReturnInstr>(module->getInt(1)));
+  g->setBody(gBody);
+  auto *fBody = module->Nr<SeriesFlow>();
+  fBody->push_back(
+      module->Nr<ReturnInstr>(module->Nr<CallInstr>(module->Nr<VarValue>(g))));
+  f->setBody(fBody);
+
+  auto *caller = cast<BodiedFunc>(module->getMainFunc());
+  auto *callerBody = module->Nr<SeriesFlow>();
+  callerBody->push_back(module->Nr<CallInstr>(module->Nr<VarValue>(f)));
+  caller->setBody(callerBody);
+
+  auto manager =
+      std::make_unique<transform::PassManager>(transform::PassManager::Init::EMPTY);
+  auto profileKey = manager->registerAnalysis(std::make_unique<HotFuncsAnalysis>(
+      std::unordered_set<seq::ir::id_t>{caller->getId(), f->getId(), g->getId()}));
+  auto pass = std::make_unique<transform::pgo::ProfileGuidedInlining>(profileKey);
+  auto *inlining = pass.get();
+  manager->registerPass(std::move(pass), "", {profileKey});
+  manager->run(module.get());
+
+  // f's call to g first, then main's call to f, with no call left in main
+  ASSERT_EQ(2, inlining->getNumInlined());
+  ASSERT_FALSE(isA<CallInstr>(callerBody->front()));
+}
@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "parser/cache.h"
+#include "parser/common.h"
+#include "parser/peg/peg.h"
+#include "parser/snapshot.h"
+#include "gtest/gtest.h"
+
+using namespace seq;
+using namespace std;
+
+namespace {
+vector<ast::Snapshot::Entry> parseAll(const shared_ptr<ast::Cache> &cache,
+                                      const vector<string> &files) {
+  vector<ast::Snapshot::Entry> entries;
+  for (auto &file : files) {
+    auto ast = ast::parseFile(cache, file);
+    string code;
+    for (auto &line : cache->imports[file].content)
+      code += line + "\n";
+    entries.push_back({file, code, ast});
+  }
+  return entries;
+}
+} // namespace
+
+TEST(SnapshotTest, RoundTrip) {
+  vector<string> files = {string(TEST_DIR) + "/parser/simplify_expr.seq",
+                          string(TEST_DIR) + "/parser/simplify_stmt.seq",
+                          string(TEST_DIR) + "/../stdlib/internal/str.seq"};
+  auto cache = make_shared<ast::Cache>();
+  auto entries = parseAll(cache, files);
+
+  auto path = "_snapshot_test." + to_string(getpid()) + ".snap";
+  ast::Snapshot::write(path, entries);
+  auto snapshot = ast::Snapshot::openFile(path);
+  ASSERT_NE(snapshot, nullptr);
+  for (auto &e : entries) {
+    auto ast = snapshot->load(cache, e.file, e.code);
+    ASSERT_NE(ast, nullptr) << e.file;
+    EXPECT_EQ(ast->toString(), e.ast->toString()) << e.file;
+  }
+  // Modified sources must not be served from the snapshot.
+  EXPECT_EQ(snapshot->load(cache, entries[0].file, entries[0].code + "pass\n"),
+            nullptr);
+  remove(path.c_str());
+}
+
+TEST(SnapshotTest, SourceMismatch) {
+  vector<string> files = {string(TEST_DIR) + "/parser/simplify_expr.seq"};
+  auto cache = make_shared<ast::Cache>();
+  auto entries = parseAll(cache, files);
+
+  auto path = "_snapshot_test." + to_string(getpid()) + ".snap";
+  ast::Snapshot::write(path, entries);
+  // Corrupt the stored source while keeping its hash record, as a hash collision
+  // would: the entry must not be served for the original source.
+  FILE *f = fopen(path.c_str(), "r+b");
+  ASSERT_NE(f, nullptr);
+  unsigned char record[8];
+  ASSERT_EQ(fseek(f, 24 + 16, SEEK_SET), 0);
+  ASSERT_EQ(fread(record, 1, 8, f), 8u);
+  long offset = 0;
+  for (int i = 7; i >= 0; i--)
+    offset = (offset << 8) | record[i];
+  ASSERT_EQ(fseek(f, offset, SEEK_SET), 0);
+  int c = fgetc(f);
+  ASSERT_EQ(fseek(f, offset, SEEK_SET), 0);
+  fputc(c ^ 1, f);
+  fclose(f);
+
+  auto snapshot = ast::Snapshot::openFile(path);
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_EQ(snapshot->load(cache, entries[0].file, entries[0].code), nullptr);
+  remove(path.c_str());
+}
+
+TEST(SnapshotTest, InvalidFile) {
+  auto path = "_snapshot_test." + to_string(getpid()) + ".bad";
+  FILE *f = fopen(path.c_str(), "w");
+  fputs("not a snapshot", f);
+  fclose(f);
+  EXPECT_EQ(ast::Snapshot::openFile(path), nullptr);
+  remove(path.c_str());
+  EXPECT_EQ(ast::Snapshot::openFile(path), nullptr);
+}